@@ -0,0 +1,612 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "cluster/cluster.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <set>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "urlfactory/urlfactory.hpp"
+
+namespace mermoz
+{
+
+void HashRing::add_node(unsigned int node_id)
+{
+  for (unsigned int v = 0; v < num_vnodes; v++) {
+    std::string key {std::to_string(node_id) + "#" + std::to_string(v)};
+    ring[fnv1a(key)] = node_id;
+  }
+}
+
+void HashRing::remove_node(unsigned int node_id)
+{
+  for (auto it = ring.begin(); it != ring.end();) {
+    if (it->second == node_id)
+      it = ring.erase(it);
+    else
+      it++;
+  }
+}
+
+void HashRing::clear()
+{
+  ring.clear();
+}
+
+unsigned int HashRing::owner(const std::string& host)
+{
+  auto it = ring.lower_bound(fnv1a(host));
+
+  if (it == ring.end())
+    it = ring.begin();
+
+  return it->second;
+}
+
+void HashRing::walk(const std::string& key, size_t max, std::vector<unsigned int>& nodes)
+{
+  nodes.clear();
+  if (ring.empty())
+    return;
+
+  auto start = ring.lower_bound(fnv1a(key));
+  if (start == ring.end())
+    start = ring.begin();
+
+  auto it = start;
+  do {
+    if (std::find(nodes.begin(), nodes.end(), it->second) == nodes.end())
+      nodes.push_back(it->second);
+
+    if (++it == ring.end())
+      it = ring.begin();
+  } while (it != start && nodes.size() < max);
+}
+
+static void put_varint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static bool get_varint(const char* data, size_t size, size_t& pos, uint64_t& value)
+{
+  value = 0;
+  for (unsigned int shift = 0; pos < size && shift < 64; shift += 7) {
+    unsigned char c = static_cast<unsigned char>(data[pos++]);
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static void put_uint32(char* out, uint32_t value)
+{
+  for (unsigned int i = 0; i < sizeof(uint32_t); i++)
+    out[i] = static_cast<char>((value >> (8*i)) & 0xff);
+}
+
+static uint32_t get_uint32(const char* data)
+{
+  uint32_t value {0};
+  for (unsigned int i = 0; i < sizeof(uint32_t); i++)
+    value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8*i);
+  return value;
+}
+
+void encode_links(unsigned int node_id,
+                  const std::vector<ForwardedLink>& links,
+                  std::string& frame)
+{
+  frame.assign(cluster_header_size, '\0');
+
+  put_varint(frame, links.size());
+  for (auto& link : links) {
+    put_varint(frame, link.url.size());
+    frame.append(link.url);
+
+    uint32_t cash;
+    std::memcpy(&cash, &link.meta.cash, sizeof(cash));
+    put_varint(frame, link.meta.depth);
+    put_varint(frame, link.meta.host_hops);
+    frame.append(sizeof(uint32_t), '\0');
+    put_uint32(&frame[frame.size() - sizeof(uint32_t)], cash);
+  }
+
+  put_uint32(&frame[0], cluster_magic);
+  put_uint32(&frame[4], static_cast<uint32_t>(node_id));
+  put_uint32(&frame[8], static_cast<uint32_t>(frame.size() - cluster_header_size));
+}
+
+bool decode_links(const char* payload,
+                  size_t size,
+                  std::vector<ForwardedLink>& links)
+{
+  size_t pos {0};
+  uint64_t count;
+
+  links.clear();
+
+  if (!get_varint(payload, size, pos, count))
+    return false;
+
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t len;
+    if (!get_varint(payload, size, pos, len) || pos + len > size)
+      return false;
+    ForwardedLink link {std::string(payload + pos, len), {0, 0, 0.0f}};
+    pos += len;
+
+    uint64_t depth, host_hops;
+    if (!get_varint(payload, size, pos, depth)
+        || !get_varint(payload, size, pos, host_hops)
+        || depth > UINT32_MAX || host_hops > UINT32_MAX
+        || pos + sizeof(uint32_t) > size)
+      return false;
+
+    uint32_t cash {get_uint32(payload + pos)};
+    pos += sizeof(uint32_t);
+
+    link.meta.depth = static_cast<uint32_t>(depth);
+    link.meta.host_hops = static_cast<uint32_t>(host_hops);
+    std::memcpy(&link.meta.cash, &cash, sizeof(cash));
+    links.push_back(std::move(link));
+  }
+
+  return pos == size;
+}
+
+/*
+ * Sockets helpers, an address is either '/unix/path' or 'host:port'
+ */
+static int open_socket(const std::string& address, bool do_listen)
+{
+  int sock {-1};
+
+  if (!address.empty() && address[0] == '/') {
+    struct sockaddr_un sun;
+    std::memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    std::strncpy(sun.sun_path, address.c_str(), sizeof(sun.sun_path) - 1);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+      return -1;
+
+    if (do_listen) {
+      unlink(address.c_str());
+      if (bind(sock, reinterpret_cast<struct sockaddr*>(&sun), sizeof(sun)) < 0
+          || listen(sock, 64) < 0) {
+        close(sock);
+        return -1;
+      }
+    } else if (connect(sock, reinterpret_cast<struct sockaddr*>(&sun), sizeof(sun)) < 0) {
+      close(sock);
+      return -1;
+    }
+
+    return sock;
+  }
+
+  size_t colon = address.rfind(':');
+  if (colon == std::string::npos)
+    return -1;
+
+  std::string host {address.substr(0, colon)};
+  std::string port {address.substr(colon + 1)};
+
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = do_listen ? AI_PASSIVE : 0;
+
+  struct addrinfo* res;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+    return -1;
+
+  for (struct addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+    if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+
+    int one {1};
+    if (do_listen) {
+      setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0 && listen(sock, 64) == 0)
+        break;
+    } else {
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+        break;
+    }
+
+    close(sock);
+    sock = -1;
+  }
+
+  freeaddrinfo(res);
+  return sock;
+}
+
+static bool write_all(int sock, const char* data, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = send(sock, data, size, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool read_all(int sock, char* data, size_t size)
+{
+  while (size > 0) {
+    ssize_t n = recv(sock, data, size, 0);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool Cluster::load_nodes()
+{
+  std::ifstream nfile(nodes_file);
+  if (!nfile.is_open())
+    return false;
+
+  std::vector<ClusterNode> nodes;
+  std::string line;
+  while (std::getline(nfile, line)) {
+    std::istringstream iss(line);
+    ClusterNode node;
+    if (line.empty() || line[0] == '#' || !(iss >> node.id >> node.address))
+      continue;
+    nodes.push_back(node);
+  }
+  nfile.close();
+
+  struct stat st;
+  if (stat(nodes_file.c_str(), &st) == 0)
+    nodes_mtime = st.st_mtime;
+
+  bool listed {false};
+  std::vector<Peer*> new_peers;
+
+  {
+    boost::unique_lock<boost::shared_mutex> lock(mutex);
+
+    ring.clear();
+    for (auto& node : nodes) {
+      ring.add_node(node.id);
+
+      if (node.id == node_id) {
+        listed = true;
+        address = node.address;
+      } else if (peers.find(node.id) == peers.end()) {
+        std::unique_ptr<Peer> p(new Peer());
+        p->node = node;
+        p->sent_links = 0;
+        p->sent_bytes = 0;
+        p->recv_links = 0;
+        p->recv_bytes = 0;
+        new_peers.push_back(p.get());
+        peers.emplace(node.id, std::move(p));
+      }
+    }
+  }
+
+  std::ostringstream oss;
+  oss << "Cluster: node " << node_id << " within " << nodes.size() << " nodes";
+  print_strong_log(oss.str());
+
+  if (status != nullptr)
+    for (auto p : new_peers)
+      start_sender(p);
+
+  return listed;
+}
+
+void Cluster::start(bool* status, ParseRingVector* content_queues)
+{
+  std::signal(SIGPIPE, SIG_IGN);
+
+  this->status = status;
+  this->content_queues = content_queues;
+
+  int sock = open_socket(address, true);
+  if (sock < 0) {
+    print_error("Cluster: cannot listen on " + address);
+  } else {
+    std::thread(listener, this, sock).detach();
+  }
+
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    for (auto& p : peers)
+      start_sender(p.second.get());
+  }
+
+  std::thread(watcher, this).detach();
+}
+
+bool Cluster::owns(const std::string& host)
+{
+  boost::shared_lock<boost::shared_mutex> lock(mutex);
+  return ring.empty() || ring.owner(host) == node_id;
+}
+
+void Cluster::forward(const std::string& host, const std::string& link, const CrawlMeta& meta)
+{
+  Peer* p;
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    auto it = peers.find(ring.owner(host));
+    p = it != peers.end() ? it->second.get() : nullptr;
+  }
+
+  if (p == nullptr)
+    return;
+
+  (*mem_sec) += link.size();
+  p->queue.push({link, meta});
+  num_forwarded++;
+}
+
+void Cluster::report(std::ostream& os)
+{
+  boost::shared_lock<boost::shared_mutex> lock(mutex);
+
+  for (auto& p : peers) {
+    os << p.first << " "
+       << p.second->sent_links << " "
+       << p.second->sent_bytes << " "
+       << p.second->recv_links << " "
+       << p.second->recv_bytes << std::endl;
+  }
+}
+
+Cluster::Peer* Cluster::peer(unsigned int id)
+{
+  boost::shared_lock<boost::shared_mutex> lock(mutex);
+  auto it = peers.find(id);
+  return it != peers.end() ? it->second.get() : nullptr;
+}
+
+void Cluster::start_sender(Peer* p)
+{
+  std::thread(sender, this, p).detach();
+}
+
+void Cluster::sender(Cluster* cls, Peer* p)
+{
+  int sock {-1};
+  unsigned int num_tries {0};
+
+  std::vector<ForwardedLink> batch;
+  std::set<std::string> in_batch;
+  size_t batch_bytes {0};
+  ForwardedLink link;
+  std::string frame;
+
+  while (*cls->status) {
+    if (p->queue.pop_for(link, batch_time_ms)) {
+      (*cls->mem_sec) -= link.url.size();
+
+      // the same link is often found on many pages of a batch, the first meta is kept
+      if (in_batch.insert(link.url).second) {
+        batch_bytes += link.url.size();
+        batch.push_back(std::move(link));
+      }
+
+      // frames stay far below what the receivers accept
+      if (batch.size() < batch_links && batch_bytes < cluster_max_payload/2)
+        continue;
+    }
+
+    if (batch.empty())
+      continue;
+
+    encode_links(cls->node_id, batch, frame);
+
+    if (sock < 0)
+      sock = open_socket(p->node.address, false);
+
+    if (sock >= 0 && write_all(sock, frame.data(), frame.size())) {
+      p->sent_links += batch.size();
+      p->sent_bytes += frame.size();
+      num_tries = 0;
+    } else {
+      if (sock >= 0)
+        close(sock);
+      sock = -1;
+
+      if (++num_tries < 3) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        continue;
+      }
+
+      /*
+       * The peer is unreachable, links are lost but they
+       * will be found again on other pages
+       */
+      std::ostringstream oss;
+      oss << "Cluster: node " << p->node.id << " unreachable, "
+          << batch.size() << " links dropped";
+      print_warning(oss.str());
+
+      cls->num_dropped += batch.size();
+      num_tries = 0;
+    }
+
+    batch.clear();
+    in_batch.clear();
+    batch_bytes = 0;
+  }
+
+  if (sock >= 0)
+    close(sock);
+}
+
+void Cluster::listener(Cluster* cls, int sock)
+{
+  while (*cls->status) {
+    int client = accept(sock, nullptr, nullptr);
+    if (client >= 0)
+      std::thread(receiver, cls, client).detach();
+  }
+
+  close(sock);
+}
+
+void Cluster::receiver(Cluster* cls, int sock)
+{
+  const unsigned int num_shards = cls->content_queues->size();
+
+  std::vector<ForwardedLink> links;
+  std::vector<LinkBatchWriter> shard_links(num_shards);
+  std::string payload;
+
+  /*
+   * A result has one meta for all its links, the links
+   * of a same page are forwarded together and share it
+   */
+  CrawlMeta batch_meta {0, 0, 0.0f};
+  auto flush = [&]() {
+    for (unsigned int s_id = 0; s_id < num_shards; s_id++) {
+      if (shard_links[s_id].empty())
+        continue;
+
+      // no 'url' nor 'host', the meta is the one of the links
+      std::unique_ptr<ParseResult> result(new ParseResult);
+      shard_links[s_id].write(result->links);
+      shard_links[s_id].clear();
+      pack_meta(result->meta, batch_meta);
+
+      (*cls->mem_sec) += result->size();
+      cls->content_queues->at(s_id).push(std::move(result));
+    }
+  };
+
+  while (*cls->status) {
+    char header[cluster_header_size];
+    if (!read_all(sock, header, cluster_header_size))
+      break;
+
+    uint32_t magic {get_uint32(header)};
+    uint32_t sender_id {get_uint32(header + 4)};
+    uint32_t payload_size {get_uint32(header + 8)};
+
+    /*
+     * A wrong magic or a size past the limit is not a Mermoz
+     * peer, or a broken one, the stream cannot be trusted anymore
+     */
+    if (magic != cluster_magic || payload_size > cluster_max_payload) {
+      std::ostringstream oss;
+      oss << "Cluster: frame of " << payload_size << " bytes from node "
+          << sender_id << " rejected, connection closed";
+      print_warning(oss.str());
+
+      cls->num_rejected++;
+      break;
+    }
+
+    payload.resize(payload_size);
+    if (!read_all(sock, &payload[0], payload.size()))
+      break;
+
+    if (!decode_links(payload.data(), payload.size(), links)) {
+      cls->num_rejected++;
+      break;
+    }
+
+    Peer* p = cls->peer(sender_id);
+    if (p != nullptr) {
+      p->recv_links += links.size();
+      p->recv_bytes += payload.size() + cluster_header_size;
+    }
+    cls->num_received += links.size();
+
+    /*
+     * Links are given to the local shards
+     * as if a parser had found them
+     */
+    for (auto& link : links) {
+      if (link.meta.depth != batch_meta.depth
+          || link.meta.host_hops != batch_meta.host_hops
+          || link.meta.cash != batch_meta.cash) {
+        flush();
+        batch_meta = link.meta;
+      }
+
+      std::string host {urlfactory::UrlParser(link.url).get_host()};
+      shard_links[host_shard(host, num_shards)].add(link.url, host);
+    }
+
+    flush();
+  }
+
+  close(sock);
+}
+
+void Cluster::watcher(Cluster* cls)
+{
+  while (*cls->status) {
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+
+    struct stat st;
+    if (stat(cls->nodes_file.c_str(), &st) == 0
+        && st.st_mtime != cls->nodes_mtime) {
+      print_strong_log("Cluster: nodes file changed, rebalancing hosts");
+      cls->load_nodes();
+    }
+  }
+}
+
+} // namespace mermoz
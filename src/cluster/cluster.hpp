@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_CLUSTER_H__
+#define MERMOZ_CLUSTER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <ctime>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "tsafe/thread_safe_queue.h"
+
+#include "common/common.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Consistent hashing of hosts over the crawl nodes
+ *
+ * Each node is placed 'num_vnodes' times on a 64 bits ring,
+ * a host belongs to the first node found clockwise of its hash.
+ * Adding a node only moves the hosts of its new ranges.
+ */
+class HashRing
+{
+public:
+  HashRing(unsigned int num_vnodes = 64) : num_vnodes(num_vnodes) {}
+
+  void add_node(unsigned int node_id);
+  void remove_node(unsigned int node_id);
+  void clear();
+
+  bool empty()
+  {
+    return ring.empty();
+  }
+
+  /*! Returns the node owning 'host' */
+  unsigned int owner(const std::string& host);
+
+  /*! Gives the first 'max' distinct nodes met from 'key' around the ring */
+  void walk(const std::string& key, size_t max, std::vector<unsigned int>& nodes);
+
+private:
+  const unsigned int num_vnodes;
+  std::map<uint64_t, unsigned int> ring;
+}; // class HashRing
+
+typedef struct ClusterNode {
+  unsigned int id;
+  std::string address; // 'host:port' for TCP or '/path' for Unix sockets
+} ClusterNode;
+
+/*
+ * Link sent to the node owning its host, with the meta
+ * it would have been given by a local parser
+ */
+typedef struct ForwardedLink {
+  std::string url;
+  CrawlMeta meta;
+} ForwardedLink;
+
+/*
+ * Links batch sent between nodes:
+ * [uint32 magic][uint32 sender id][uint32 payload size], little-endian,
+ * followed by the payload [varint count]([varint size][bytes][meta])*
+ * where meta is [varint depth][varint host_hops][uint32 cash bits]
+ */
+static const uint32_t cluster_magic {0x4c5a4d4d}; // "MMZL"
+static const size_t cluster_header_size {3*sizeof(uint32_t)};
+static const uint32_t cluster_max_payload {16U << 20}; // larger frames close the connection
+
+void encode_links(unsigned int node_id,
+                  const std::vector<ForwardedLink>& links,
+                  std::string& frame);
+bool decode_links(const char* payload,
+                  size_t size,
+                  std::vector<ForwardedLink>& links);
+
+/*! \brief Host partitioned crawl over several Mermoz processes
+ *
+ * Every process owns the hosts the ring gives to its 'node_id',
+ * links found for hosts owned elsewhere are batched per peer and
+ * shipped over sockets. The nodes file ('id address' per line) is
+ * watched, so appending a node rebalances the ring at runtime.
+ */
+class Cluster
+{
+public:
+  Cluster(unsigned int node_id,
+          std::string nodes_file,
+          MemSec* mem_sec) :
+    node_id(node_id),
+    nodes_file(nodes_file),
+    nodes_mtime(0),
+    mem_sec(mem_sec),
+    status(nullptr),
+    content_queues(nullptr),
+    num_forwarded(0),
+    num_received(0),
+    num_dropped(0),
+    num_rejected(0) {}
+
+  /*! Reads the nodes file, returns false if this node is not listed */
+  bool load_nodes();
+
+  /*! Starts the listener, the senders and the nodes file watcher */
+  void start(bool* status, ParseRingVector* content_queues);
+
+  /*! Returns true if the host is crawled by this node */
+  bool owns(const std::string& host);
+
+  /*! Queues 'link', of meta 'meta', for the node owning 'host' */
+  void forward(const std::string& host, const std::string& link, const CrawlMeta& meta);
+
+  uint64_t forwarded()
+  {
+    return num_forwarded;
+  }
+
+  uint64_t received()
+  {
+    return num_received;
+  }
+
+  uint64_t dropped()
+  {
+    return num_dropped;
+  }
+
+  uint64_t rejected()
+  {
+    return num_rejected;
+  }
+
+  /*! Writes one line per peer: id sent_links sent_bytes recv_links recv_bytes */
+  void report(std::ostream& os);
+
+  static const size_t batch_links {1024};
+  static const long batch_time_ms {200};
+
+private:
+  typedef struct Peer {
+    ClusterNode node;
+    thread_safe::queue<ForwardedLink> queue;
+    std::atomic<uint64_t> sent_links;
+    std::atomic<uint64_t> sent_bytes;
+    std::atomic<uint64_t> recv_links;
+    std::atomic<uint64_t> recv_bytes;
+  } Peer;
+
+  const unsigned int node_id;
+  const std::string nodes_file;
+  std::time_t nodes_mtime;
+  std::string address;
+
+  MemSec* mem_sec;
+
+  boost::shared_mutex mutex;
+  HashRing ring;
+  std::map<unsigned int, std::unique_ptr<Peer>> peers; // never erased
+
+  bool* status;
+  ParseRingVector* content_queues;
+
+  std::atomic<uint64_t> num_forwarded;
+  std::atomic<uint64_t> num_received;
+  std::atomic<uint64_t> num_dropped; // links lost with unreachable peers
+  std::atomic<uint64_t> num_rejected; // frames over cluster_max_payload or malformed
+
+  Peer* peer(unsigned int id);
+  void start_sender(Peer* p);
+
+  static void sender(Cluster* cls, Peer* p);
+  static void listener(Cluster* cls, int sock);
+  static void receiver(Cluster* cls, int sock);
+  static void watcher(Cluster* cls);
+}; // class Cluster
+
+} // namespace mermoz
+
+#endif // MERMOZ_CLUSTER_H__
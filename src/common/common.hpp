@@ -35,5 +35,10 @@
 #include "common/packer.hpp"
 #include "common/httpfetch.hpp"
 #include "common/memsec.hpp"
+#include "common/hashing.hpp"
+#include "common/linkbatch.hpp"
+#include "common/contentset.hpp"
+#include "common/histogram.hpp"
+#include "common/messages.hpp"
 
 #endif // MERMOZ_COMMON_H__
@@ -0,0 +1,97 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "common/contentset.hpp"
+
+namespace mermoz
+{
+
+ContentSet::ContentSet(MemSec* mem_sec) :
+  mem_sec(mem_sec),
+  num_duplicates(0)
+{
+  for (auto& shard : shards) {
+    shard.table.assign(initial_size, Entry {0, 0, 0});
+    shard.size = 0;
+  }
+
+  (*mem_sec) += num_shards*initial_size*sizeof(Entry);
+}
+
+void ContentSet::grow(Shard& shard)
+{
+  std::vector<Entry> table(2*shard.table.size(), Entry {0, 0, 0});
+  const size_t mask {table.size() - 1};
+
+  for (auto& entry : shard.table) {
+    if (entry.h2 == 0)
+      continue;
+
+    size_t i = entry.h1 & mask;
+    while (table[i].h2 != 0)
+      i = (i + 1) & mask;
+    table[i] = entry;
+  }
+
+  (*mem_sec) += shard.table.size()*sizeof(Entry);
+  shard.table.swap(table);
+}
+
+bool ContentSet::insert(Digest128 digest, uint64_t fp, uint64_t& first)
+{
+  // 0 marks the free entries
+  if (digest.h2 == 0)
+    digest.h2 = 1;
+
+  Shard& shard = shards[digest.h2 >> 58];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  const size_t mask {shard.table.size() - 1};
+  size_t i = digest.h1 & mask;
+
+  while (shard.table[i].h2 != 0) {
+    const Entry& entry = shard.table[i];
+    if (entry.h1 == digest.h1 && entry.h2 == digest.h2) {
+      first = entry.fp;
+      if (first != fp)
+        num_duplicates++;
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+
+  shard.table[i] = {digest.h1, digest.h2, fp};
+
+  // at most half full, probes stay short
+  if (++shard.size*2 > shard.table.size())
+    grow(shard);
+
+  return true;
+}
+
+} // namespace mermoz
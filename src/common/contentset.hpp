@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_CONTENTSET_H__
+#define MERMOZ_CONTENTSET_H__
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "common/hashing.hpp"
+#include "common/memsec.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Digests of the pages fetched, shared by the fetchers
+ *
+ * Each digest keeps the fingerprint of the first URL which gave it.
+ * The set is split into 'num_shards' open addressing tables of 24
+ * bytes entries, each one with its lock, chosen by the digest.
+ */
+class ContentSet
+{
+public:
+  ContentSet(MemSec* mem_sec);
+
+  /*! Adds 'digest' of the page of URL 'fp', returns false if it was
+   * known and then gives 'first' the URL which gave it first
+   */
+  bool insert(Digest128 digest, uint64_t fp, uint64_t& first);
+
+  uint64_t duplicates() const
+  {
+    return num_duplicates;
+  }
+
+private:
+  typedef struct Entry {
+    uint64_t h1;
+    uint64_t h2; // never 0 once used
+    uint64_t fp;
+  } Entry;
+
+  typedef struct alignas(64) Shard {
+    std::mutex mutex;
+    std::vector<Entry> table;
+    size_t size;
+  } Shard;
+
+  void grow(Shard& shard);
+
+  static const unsigned int num_shards {64};
+  static const size_t initial_size {1024};
+
+  Shard shards[num_shards];
+  MemSec* mem_sec;
+  std::atomic<uint64_t> num_duplicates;
+}; // class ContentSet
+
+} // namespace mermoz
+
+#endif // MERMOZ_CONTENTSET_H__
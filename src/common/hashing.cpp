@@ -0,0 +1,164 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "common/hashing.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace mermoz
+{
+
+uint64_t fnv1a(const char* data, size_t size)
+{
+  uint64_t hash {0xcbf29ce484222325ULL};
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+uint64_t fnv1a(const std::string& s)
+{
+  return fnv1a(s.data(), s.size());
+}
+
+unsigned int host_shard(const std::string& host, unsigned int num_shards)
+{
+  if (num_shards <= 1)
+    return 0;
+
+  return static_cast<unsigned int>(fnv1a(host) % num_shards);
+}
+
+static const uint64_t c1 {0x87c37b91114253d5ULL};
+static const uint64_t c2 {0x4cf5ad432745937fULL};
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+void StreamHash::reset()
+{
+  h1 = 0;
+  h2 = 0;
+  length = 0;
+  tail_size = 0;
+}
+
+void StreamHash::block(const char* data)
+{
+  uint64_t k1;
+  uint64_t k2;
+  std::memcpy(&k1, data, 8);
+  std::memcpy(&k2, data + 8, 8);
+
+  k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+  h1 = rotl(h1, 27); h1 += h2; h1 = h1*5 + 0x52dce729;
+
+  k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+  h2 = rotl(h2, 31); h2 += h1; h2 = h2*5 + 0x38495ab5;
+}
+
+void StreamHash::update(const char* data, size_t size)
+{
+  length += size;
+
+  // completes the block left by the previous chunk
+  if (tail_size > 0) {
+    size_t n = std::min(size, 16 - tail_size);
+    std::memcpy(tail + tail_size, data, n);
+    tail_size += n;
+    data += n;
+    size -= n;
+
+    if (tail_size < 16)
+      return;
+
+    block(tail);
+    tail_size = 0;
+  }
+
+  for (; size >= 16; data += 16, size -= 16)
+    block(data);
+
+  std::memcpy(tail, data, size);
+  tail_size = size;
+}
+
+Digest128 StreamHash::digest() const
+{
+  uint64_t r1 {h1};
+  uint64_t r2 {h2};
+  uint64_t k1 {0};
+  uint64_t k2 {0};
+
+  const unsigned char* t = reinterpret_cast<const unsigned char*>(tail);
+
+  for (size_t i = tail_size; i > 8; i--)
+    k2 ^= static_cast<uint64_t>(t[i - 1]) << ((i - 9)*8);
+  if (tail_size > 8) {
+    k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; r2 ^= k2;
+  }
+
+  for (size_t i = std::min<size_t>(tail_size, 8); i > 0; i--)
+    k1 ^= static_cast<uint64_t>(t[i - 1]) << ((i - 1)*8);
+  if (tail_size > 0) {
+    k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; r1 ^= k1;
+  }
+
+  r1 ^= length;
+  r2 ^= length;
+
+  r1 += r2;
+  r2 += r1;
+
+  r1 = fmix(r1);
+  r2 = fmix(r2);
+
+  r1 += r2;
+  r2 += r1;
+
+  return {r1, r2};
+}
+
+} // namespace mermoz
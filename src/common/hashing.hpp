@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_HASHING_H__
+#define MERMOZ_HASHING_H__
+
+#include <cstdint>
+#include <string>
+
+namespace mermoz
+{
+
+/*
+ * 64 bits FNV-1a, stable between runs and machines
+ * thus usable to share hosts among shards or nodes
+ */
+uint64_t fnv1a(const char* data, size_t size);
+uint64_t fnv1a(const std::string& s);
+
+/*
+ * Returns the urlserver shard owning 'host'
+ */
+unsigned int host_shard(const std::string& host, unsigned int num_shards);
+
+typedef struct Digest128 {
+  uint64_t h1;
+  uint64_t h2;
+} Digest128;
+
+/*! \brief 128 bits MurmurHash3 (x64), fed chunk by chunk
+ *
+ * A page is hashed while libcurl receives it, the
+ * digest does not depend on how the page was split
+ */
+class StreamHash
+{
+public:
+  StreamHash() { reset(); }
+
+  void reset();
+
+  void update(const char* data, size_t size);
+
+  Digest128 digest() const;
+
+private:
+  void block(const char* data);
+
+  uint64_t h1;
+  uint64_t h2;
+  uint64_t length;
+  char tail[16];
+  size_t tail_size;
+}; // class StreamHash
+
+} // namespace mermoz
+
+#endif // MERMOZ_HASHING_H__
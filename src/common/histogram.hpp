@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_HISTOGRAM_H__
+#define MERMOZ_HISTOGRAM_H__
+
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+namespace mermoz
+{
+
+/*! \brief Counts of durations within power of two buckets of microseconds
+ *
+ * Bucket 0 holds [0, 2) us, bucket 'i' holds [2^i, 2^(i+1)) us and the
+ * last one everything above. Many threads may add at once.
+ */
+class Histogram
+{
+public:
+  Histogram()
+  {
+    for (auto& count : counts)
+      count = 0;
+  }
+
+  void add(uint64_t us)
+  {
+    unsigned int b = us < 2 ? 0 : 63 - __builtin_clzll(us);
+    counts[b < num_buckets ? b : num_buckets - 1]++;
+  }
+
+  /*! Writes the counts separated by spaces */
+  void write(std::ostream& os) const
+  {
+    for (unsigned int b = 0; b < num_buckets; b++)
+      os << (b > 0 ? " " : "") << counts[b];
+  }
+
+  static const unsigned int num_buckets {24}; // up to 8 s
+
+private:
+  std::atomic<uint64_t> counts[num_buckets];
+}; // class Histogram
+
+} // namespace mermoz
+
+#endif // MERMOZ_HISTOGRAM_H__
@@ -41,7 +41,10 @@ long http_fetch(std::string& url,
                 std::string& eff_url,
                 std::string& content,
                 long time_out,
-                const std::string user_agent)
+                const std::string user_agent,
+                FetchInfo* info,
+                const std::string& ip,
+                StreamHash* hash)
 {
   urlfactory::UrlParser up(url);
 
@@ -50,7 +53,7 @@ long http_fetch(std::string& url,
 
   url = up.get_url();
 
-  long res = curl_wraper(url, eff_url, content, time_out, user_agent);
+  long res = curl_wraper(url, eff_url, content, time_out, user_agent, info, ip, hash);
 
   if (!(res >= 200 && res < 300)) {
     std::ostringstream oss;
@@ -61,14 +64,72 @@ long http_fetch(std::string& url,
   return res;
 }
 
+/*
+ * Easy handle of a thread, options are reset before each use but
+ * the addresses given by CURLOPT_RESOLVE stay in its DNS cache
+ * until removed by '-host:port' entries
+ */
+class CurlHandle
+{
+public:
+  CurlHandle() : curl(curl_easy_init()) {}
+
+  ~CurlHandle()
+  {
+    if (curl)
+      curl_easy_cleanup(curl);
+  }
+
+  CURL* get()
+  {
+    if (curl)
+      curl_easy_reset(curl);
+    return curl;
+  }
+
+  /*! Returns the entries giving 'ip' to 'host', after the removal of the previous ones */
+  struct curl_slist* resolve(const std::string& host, const std::string& ip)
+  {
+    struct curl_slist* list {nullptr};
+
+    if (!pinned.empty()) {
+      list = curl_slist_append(list, ("-" + pinned + ":80").c_str());
+      list = curl_slist_append(list, ("-" + pinned + ":443").c_str());
+      pinned.clear();
+    }
+
+    if (!ip.empty()) {
+      list = curl_slist_append(list, (host + ":80:" + ip).c_str());
+      list = curl_slist_append(list, (host + ":443:" + ip).c_str());
+      pinned = host;
+    }
+
+    return list;
+  }
+
+private:
+  CURL* curl;
+  std::string pinned; // host given an address by the last fetch
+};
+
 long curl_wraper(std::string& url,
                  std::string& eff_url,
                  std::string& content,
                  long time_out,
-                 const std::string user_agent)
+                 const std::string user_agent,
+                 FetchInfo* info,
+                 const std::string& ip,
+                 StreamHash* hash)
 {
-  // Basic CURL initalizer
-  CURL* curl = curl_easy_init();
+  if (info != nullptr)
+    *info = {-1.0, -1.0, -1.0};
+
+  /*
+   * Each thread keeps its handle, so the connections
+   * and DNS entries of a host are reused by its next URLs
+   */
+  static thread_local CurlHandle handle;
+  CURL* curl = handle.get();
 
   // Saving HTTP error codes CODE \in [100; 600[
   // or libCURL error codes CODE \in [0; 100[
@@ -86,11 +147,31 @@ long curl_wraper(std::string& url,
 
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, time_out); // defines timeout
 
+    /*
+     * The address found by the dispatcher is given to libcurl,
+     * IPv6 ones are left to its resolver
+     */
+    struct curl_slist* resolve {nullptr};
+    if (!ip.empty() && ip.find(':') == std::string::npos)
+      resolve = handle.resolve(urlfactory::UrlParser(url).get_host(), ip);
+    else
+      resolve = handle.resolve("", "");
+
+    if (resolve != nullptr)
+      curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+
     /*
      * Define function for saving page content
      */
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_function);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &content);
+    HashedContent hashed {&content, hash};
+    if (hash != nullptr) {
+      hash->reset();
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, hashed_write_function);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &hashed);
+    } else {
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_function);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &content);
+    }
 
     /*
      * Let's fetch the URL with the previously
@@ -133,10 +214,21 @@ long curl_wraper(std::string& url,
       http_code = res;
     }
 
+    if (resolve != nullptr) {
+      curl_easy_setopt(curl, CURLOPT_RESOLVE, nullptr);
+      curl_slist_free_all(resolve);
+    }
+
     /*
-     * Mandatory after curl was INIT and not equal to NULL
+     * Timings are known even if the transfer failed,
+     * a timeout gives the time spent waiting
      */
-    curl_easy_cleanup(curl);
+    if (info != nullptr) {
+      curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &info->connect_time);
+      curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &info->first_byte_time);
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &info->total_time);
+    }
+
   }
 
   return http_code;
@@ -155,4 +247,18 @@ size_t write_function (char* ptr,
   return relsize;
 }
 
+size_t hashed_write_function (char* ptr,
+                              size_t size,
+                              size_t nmemb,
+                              void* userdata)
+{
+  HashedContent* hashed = reinterpret_cast<HashedContent*>(userdata);
+
+  size_t relsize = size*nmemb;
+  hashed->content->append(ptr, relsize);
+  hashed->hash->update(ptr, relsize);
+
+  return relsize;
+}
+
 } // namespace mermoz
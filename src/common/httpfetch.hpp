@@ -35,27 +35,62 @@
 #include <curl/curl.h>
 
 #include "urlfactory/urlfactory.hpp"
+#include "common/hashing.hpp"
 
 namespace mermoz
 {
 
+/*
+ * Timings of a fetch given by libcurl, in seconds
+ * from its start, -1 if unknown
+ */
+typedef struct FetchInfo {
+  double connect_time; // TCP connection done
+  double first_byte_time; // first byte of the answer received
+  double total_time; // transfer done
+} FetchInfo;
+
 long http_fetch(std::string& url,
                 std::string& eff_url,
                 std::string& content,
                 long time_out,
-                const std::string user_agent);
+                const std::string user_agent,
+                FetchInfo* info = nullptr,
+                const std::string& ip = std::string(),
+                StreamHash* hash = nullptr);
 
+/*
+ * 'ip', if not empty, is the address of the host of 'url',
+ * libcurl does not resolve it. 'hash', if given, is fed
+ * with the content while it is received
+ */
 long curl_wraper(std::string& url,
                  std::string& eff_url,
                  std::string& content,
                  long time_out,
-                 const std::string user_agent);
+                 const std::string user_agent,
+                 FetchInfo* info = nullptr,
+                 const std::string& ip = std::string(),
+                 StreamHash* hash = nullptr);
 
 size_t write_function (char* ptr,
                        size_t size,
                        size_t nmemb,
                        void* userdata);
 
+/*
+ * Same as 'write_function', 'userdata' is a 'HashedContent'
+ */
+typedef struct HashedContent {
+  std::string* content;
+  StreamHash* hash;
+} HashedContent;
+
+size_t hashed_write_function (char* ptr,
+                              size_t size,
+                              size_t nmemb,
+                              void* userdata);
+
 } // namespace mermoz
 
 #endif // MERMOZ_HTTPFETCH_H__
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "common/linkbatch.hpp"
+
+#include <cstring>
+
+#include "common/hashing.hpp"
+
+namespace mermoz
+{
+
+static const size_t batch_header_size {2*sizeof(uint32_t)};
+
+void LinkBatchWriter::add(const std::string& url, const std::string& host)
+{
+  LinkRecord record;
+  record.fp = fnv1a(url);
+  record.host_id = fnv1a(host);
+  record.url_offset = static_cast<uint32_t>(arena.size());
+  record.url_size = static_cast<uint32_t>(url.size());
+  record.host_size = static_cast<uint32_t>(host.size());
+
+  size_t pos = url.find(host);
+  if (pos != std::string::npos) {
+    record.host_offset = record.url_offset + static_cast<uint32_t>(pos);
+    arena.append(url);
+  } else {
+    arena.append(url);
+    record.host_offset = static_cast<uint32_t>(arena.size());
+    arena.append(host);
+  }
+
+  records.push_back(record);
+}
+
+void LinkBatchWriter::write(std::string& out) const
+{
+  uint32_t header[2] = {static_cast<uint32_t>(records.size()),
+                        static_cast<uint32_t>(arena.size())};
+
+  out.clear();
+  out.reserve(batch_header_size + records.size()*sizeof(LinkRecord) + arena.size());
+  out.append(reinterpret_cast<const char*>(header), batch_header_size);
+  out.append(reinterpret_cast<const char*>(records.data()),
+             records.size()*sizeof(LinkRecord));
+  out.append(arena);
+}
+
+LinkBatch::LinkBatch(const std::string& flat) :
+  records(nullptr),
+  arena(nullptr),
+  count(0)
+{
+  uint32_t header[2];
+  if (flat.size() < batch_header_size)
+    return;
+
+  std::memcpy(header, flat.data(), batch_header_size);
+  if (flat.size() != batch_header_size
+                     + static_cast<size_t>(header[0])*sizeof(LinkRecord)
+                     + header[1])
+    return;
+
+  records = flat.data() + batch_header_size;
+  arena = records + header[0]*sizeof(LinkRecord);
+  count = header[0];
+}
+
+Link LinkBatch::operator[](size_t i) const
+{
+  LinkRecord record;
+  std::memcpy(&record, records + i*sizeof(LinkRecord), sizeof(LinkRecord));
+
+  return {record.fp,
+          record.host_id,
+          arena + record.url_offset,
+          record.url_size,
+          arena + record.host_offset,
+          record.host_size};
+}
+
+} // namespace mermoz
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_LINKBATCH_H__
+#define MERMOZ_LINKBATCH_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace mermoz
+{
+
+/*! One link of a batch, the strings point within the batch */
+typedef struct Link {
+  uint64_t fp; // fingerprint of the URL
+  uint64_t host_id; // fingerprint of the host
+  const char* url;
+  uint32_t url_size;
+  const char* host;
+  uint32_t host_size;
+} Link;
+
+/*
+ * Flat layout of a batch:
+ * [count u32][arena size u32][count records][arena]
+ * the host is most often found within its URL in the arena
+ */
+typedef struct LinkRecord {
+  uint64_t fp;
+  uint64_t host_id;
+  uint32_t url_offset;
+  uint32_t url_size;
+  uint32_t host_offset;
+  uint32_t host_size;
+} LinkRecord;
+
+/*! \brief Builds the links batch sent by a parser to a urlserver shard */
+class LinkBatchWriter
+{
+public:
+  /*! 'url' is normalized, 'host' is its host */
+  void add(const std::string& url, const std::string& host);
+
+  /*! Writes the flat batch into 'out' */
+  void write(std::string& out) const;
+
+  size_t size() const
+  {
+    return records.size();
+  }
+
+  bool empty() const
+  {
+    return records.empty();
+  }
+
+  void clear()
+  {
+    records.clear();
+    arena.clear();
+  }
+
+private:
+  std::vector<LinkRecord> records;
+  std::string arena;
+}; // class LinkBatchWriter
+
+/*! \brief Read only view of a flat batch, nothing is copied
+ *
+ * The viewed string must outlive the view, a batch
+ * which is not valid is seen as empty
+ */
+class LinkBatch
+{
+public:
+  LinkBatch(const std::string& flat);
+
+  size_t size() const
+  {
+    return count;
+  }
+
+  Link operator[](size_t i) const;
+
+private:
+  const char* records;
+  const char* arena;
+  uint32_t count;
+}; // class LinkBatch
+
+} // namespace mermoz
+
+#endif // MERMOZ_LINKBATCH_H__
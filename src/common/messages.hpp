@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_MESSAGES_H__
+#define MERMOZ_MESSAGES_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "tsafe/thread_safe_queue.h"
+#include "tsafe/thread_safe_ring.h"
+
+namespace mermoz
+{
+
+/*
+ * Messages between the stages, moved by pointer thus never copied,
+ * 'size()' is what they weigh for 'MemSec'. The numbers are kept as
+ * such, 'digest' is only meaningful for a 2xx 'http_status'
+ */
+
+/*
+ * URL to fetch, from the urlserver to a fetcher
+ */
+typedef struct FetchTask {
+  std::string host;
+  std::string url;
+  std::string meta; // packed 'CrawlMeta'
+  std::string ip; // resolved by the dispatcher, empty if not
+
+  size_t size() const
+  {
+    return host.size() + url.size() + meta.size() + ip.size();
+  }
+} FetchTask;
+
+/*
+ * Fetched page, from a fetcher to a parser
+ */
+typedef struct FetchResult {
+  std::string url;
+  std::string eff_url;
+  long http_status;
+  std::string content;
+  std::string host;
+  std::string meta;
+  long latency; // to the first byte, in ms
+  uint64_t digest; // of the content
+
+  size_t size() const
+  {
+    return url.size() + eff_url.size() + content.size() + host.size() + meta.size();
+  }
+} FetchResult;
+
+/*
+ * Result of a page for one urlserver shard, the fields
+ * about 'url' only go to the shard owning its host
+ */
+typedef struct ParseResult {
+  std::string url;
+  std::string eff_url;
+  long http_status {0};
+  std::string text;
+  std::string links; // flat 'LinkBatch' of the shard
+  std::string host; // of the page, parent of its links
+  std::string meta; // packed, given to the links
+  uint64_t digest {0}; // of the content
+  long latency {-1}; // -1 if unknown
+  uint64_t content_size {0};
+  uint64_t alias {0}; // fingerprint of the first URL with the same content, 0 if none
+
+  size_t size() const
+  {
+    return url.size() + eff_url.size() + text.size() + links.size()
+           + host.size() + meta.size();
+  }
+} ParseResult;
+
+// one per fetcher
+using FetchQueueVector = std::vector<thread_safe::queue<std::unique_ptr<FetchTask>>>;
+
+// one per urlserver shard
+using ParseRing = thread_safe::ring<std::unique_ptr<ParseResult>>;
+using ParseRingVector = std::vector<ParseRing>;
+
+} // namespace mermoz
+
+#endif // MERMOZ_MESSAGES_H__
@@ -65,29 +65,59 @@ void pack(std::string& pack, std::initializer_list<std::string*> args)
   }
 }
 
-void unpack(std::string& pack, std::initializer_list<std::string*> args)
+bool unpack(std::string& pack, std::initializer_list<std::string*> args)
 {
-  std::string::iterator itpack = pack.begin();
+  size_t pos {0};
+  bool complete {true};
 
   for (auto& arg : args)
   {
+    arg->clear();
+
     size_t arg_size;
+    if (!complete || pack.size() - pos < sizeof(size_t)) {
+      complete = false;
+      continue;
+    }
 
     std::memcpy((void*)(&arg_size),
-                (void*)(&*itpack),
+                (void*)(pack.data() + pos),
                 sizeof(size_t));
 
-    itpack += sizeof(size_t);
+    pos += sizeof(size_t);
 
-    arg->clear();
-    arg->resize(arg_size);
+    if (pack.size() - pos < arg_size) {
+      complete = false;
+      continue;
+    }
 
-    std::memcpy((void*)(&*arg->begin()),
-                (void*)(&*itpack),
-                arg_size);
+    arg->assign(pack.data() + pos, arg_size);
 
-    itpack += arg_size;
+    pos += arg_size;
   }
+
+  return complete;
+}
+
+void pack_meta(std::string& pack, const CrawlMeta& meta)
+{
+  pack.resize(sizeof(CrawlMeta));
+  std::memcpy((void*)(&*pack.begin()),
+              (void*)(&meta),
+              sizeof(CrawlMeta));
+}
+
+bool unpack_meta(const std::string& pack, CrawlMeta& meta)
+{
+  if (pack.size() != sizeof(CrawlMeta)) {
+    meta = {0, 0, 1.0f};
+    return false;
+  }
+
+  std::memcpy((void*)(&meta),
+              (void*)(pack.data()),
+              sizeof(CrawlMeta));
+  return true;
 }
 
 } // namespace mermoz
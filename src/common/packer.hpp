@@ -31,13 +31,34 @@
 
 #include <string>
 #include <cstring>
+#include <cstdint>
 #include <initializer_list>
 
 namespace mermoz
 {
 
 void pack(std::string& pack, std::initializer_list<std::string*> args);
-void unpack(std::string& pack, std::initializer_list<std::string*> args);
+
+/*
+ * Returns false if 'pack' holds fewer fields than 'args',
+ * the fields missing are left empty
+ */
+bool unpack(std::string& pack, std::initializer_list<std::string*> args);
+
+/*
+ * Crawl information following an URL from the urlserver
+ * to the parser, and given by the parser to the found links
+ */
+typedef struct CrawlMeta {
+  uint32_t depth; // hops from a seed
+  uint32_t host_hops; // host changes from a seed
+  float cash; // OPIC importance
+} CrawlMeta;
+
+void pack_meta(std::string& pack, const CrawlMeta& meta);
+
+/*! Returns false, and seed-like values, if 'pack' is not a meta */
+bool unpack_meta(const std::string& pack, CrawlMeta& meta);
 
 } // namespace mermoz
 
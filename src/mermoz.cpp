@@ -33,8 +33,11 @@
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <algorithm>
 
 #include <unistd.h>
+#include <sys/resource.h>
 #include <curl/curl.h>
 
 #ifdef MMZ_PROFILE
@@ -47,8 +50,10 @@ namespace po = boost::program_options;
 #include "tsafe/thread_safe_queue.h"
 
 #include "common/common.hpp"
+#include "cluster/cluster.hpp"
 #include "spider/spider.hpp"
 #include "urlserver/urlserver.hpp"
+#include "urlserver/checkpoint.hpp"
 
 using namespace mermoz;
 
@@ -66,6 +71,7 @@ int main (int argc, char** argv)
   ("help", "displays this message")
   ("settings", po::value<std::string>(), "setting file for the whole Mermoz run")
   ("seeds", po::value<std::string>(), "list of seeds for the current run")
+  ("resume", "restarts the crawl from the last checkpoint")
   ;
 
   po::variables_map vmap;
@@ -90,7 +96,25 @@ int main (int argc, char** argv)
   std::string user_agent;
   unsigned int nfetchers {0};
   unsigned int nparsers {0};
+  unsigned int nshards {1};
   int max_ram {0};
+  unsigned int node_id {0};
+  std::string nodes_file;
+  std::string checkpoint_dir;
+  long checkpoint_interval {300};
+  FrontierWeights weights {1.0f, 1.0f, 1.0f, 1.0f};
+  RecrawlSettings recrawl {0.0f, 3600L, 30L*24*3600};
+  unsigned int ip_max_fetch {16};
+  DomainBudget budget {0, 0, 0};
+  std::string suffix_file {"public_suffix_list.dat"};
+  TrapSettings traps {16, 3, 1000};
+  unsigned int dust_min {3};
+  bool content_dedup {true};
+  unsigned int simhash_bits {3};
+  size_t simhash_mb {16};
+  ParseMode parse_mode {PARSE_DOM};
+  ParseLimits parse_limits {2048UL << 10, 200000, 256, 1000};
+  bool send_text {false};
 
   while(!settingsfile.eof()) {
     line.clear();
@@ -100,14 +124,89 @@ int main (int argc, char** argv)
     while ((c = *(line.end()-1)) < 0x20 && !line.empty())
       line.pop_back();
 
-    if ((pos = line.find("fetchers")) != std::string::npos)
-      nfetchers = static_cast<unsigned int>(std::atoi(line.substr(pos + 9).c_str()));
-    else if ((pos = line.find("parsers")) != std::string::npos)
-      nparsers = static_cast<unsigned int>(std::atoi(line.substr(pos + 8).c_str()));
-    else if ((pos = line.find("user-agent")) != std::string::npos)
-      user_agent = line.substr(pos + 11);
-    else if ((pos = line.find("max-ram")) != std::string::npos)
-      max_ram = std::atoi(line.substr(pos + 8).c_str());
+    pos = line.find(' ');
+    if (pos == std::string::npos)
+      continue;
+
+    // whole keys, "nodes" must not match "parse-max-nodes"
+    std::string key {line.substr(0, pos)};
+    std::string value {line.substr(pos + 1)};
+
+    if (key.compare("fetchers") == 0)
+      nfetchers = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("parsers") == 0)
+      nparsers = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("user-agent") == 0)
+      user_agent = value;
+    else if (key.compare("max-ram") == 0)
+      max_ram = std::atoi(value.c_str());
+    else if (key.compare("urlservers") == 0)
+      nshards = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("node-id") == 0)
+      node_id = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("nodes") == 0)
+      nodes_file = value;
+    else if (key.compare("checkpoint-dir") == 0)
+      checkpoint_dir = value;
+    else if (key.compare("checkpoint-interval") == 0)
+      checkpoint_interval = std::atol(value.c_str());
+    else if (key.compare("score-depth") == 0)
+      weights.depth = std::atof(value.c_str());
+    else if (key.compare("score-opic") == 0)
+      weights.opic = std::atof(value.c_str());
+    else if (key.compare("score-seed") == 0)
+      weights.seed = std::atof(value.c_str());
+    else if (key.compare("score-host") == 0)
+      weights.host = std::atof(value.c_str());
+    else if (key.compare("trap-max-depth") == 0)
+      traps.max_depth = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("trap-max-repeat") == 0)
+      traps.max_repeat = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("trap-pattern-max") == 0)
+      traps.pattern_max = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("parse-max-kb") == 0)
+      parse_limits.max_bytes = std::strtoull(value.c_str(), nullptr, 10) << 10;
+    else if (key.compare("parse-max-nodes") == 0)
+      parse_limits.max_nodes = std::strtoull(value.c_str(), nullptr, 10);
+    else if (key.compare("parse-max-depth") == 0)
+      parse_limits.max_depth = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("parse-max-ms") == 0)
+      parse_limits.max_ms = std::strtoull(value.c_str(), nullptr, 10);
+    else if (key.compare("parse-mode") == 0) {
+      std::string mode {value};
+      if (mode.compare("scan") == 0)
+        parse_mode = PARSE_SCAN;
+      else if (mode.compare("compare") == 0)
+        parse_mode = PARSE_COMPARE;
+      else if (mode.compare("dom") != 0)
+        print_warning("Unknown parse-mode " + mode + ", the tree is built");
+    }
+    else if (key.compare("send-text") == 0)
+      send_text = std::atoi(value.c_str()) != 0;
+    else if (key.compare("simhash-bits") == 0)
+      simhash_bits = std::min(7, std::max(0, std::atoi(value.c_str())));
+    else if (key.compare("simhash-mb") == 0)
+      simhash_mb = std::strtoull(value.c_str(), nullptr, 10);
+    else if (key.compare("content-dedup") == 0)
+      content_dedup = std::atoi(value.c_str()) != 0;
+    else if (key.compare("dust-min") == 0)
+      dust_min = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("domain-max-pages") == 0)
+      budget.max_pages = std::strtoull(value.c_str(), nullptr, 10);
+    else if (key.compare("domain-max-mb") == 0)
+      budget.max_bytes = std::strtoull(value.c_str(), nullptr, 10) << 20;
+    else if (key.compare("max-depth") == 0)
+      budget.max_depth = static_cast<uint32_t>(std::atoi(value.c_str()));
+    else if (key.compare("public-suffix") == 0)
+      suffix_file = value;
+    else if (key.compare("ip-max-fetch") == 0)
+      ip_max_fetch = static_cast<unsigned int>(std::atoi(value.c_str()));
+    else if (key.compare("recrawl-share") == 0)
+      recrawl.share = std::atof(value.c_str());
+    else if (key.compare("recrawl-min") == 0)
+      recrawl.min_interval = std::atol(value.c_str());
+    else if (key.compare("recrawl-max") == 0)
+      recrawl.max_interval = std::atol(value.c_str());
   }
   settingsfile.close();
 
@@ -118,7 +217,10 @@ int main (int argc, char** argv)
   if (user_agent.empty() ||
       nfetchers == 0 ||
       nparsers == 0 ||
-      max_ram == 0) {
+      nshards == 0 ||
+      max_ram == 0 ||
+      recrawl.min_interval <= 0 ||
+      recrawl.max_interval < recrawl.min_interval) {
     print_error("Wrong settings Mermoz cannot start");
   } else {
     print_strong_log("Staring of Mermoz with following settings:");
@@ -132,6 +234,10 @@ int main (int argc, char** argv)
     oss << "Parsers: " << nparsers;
     print_strong_log(oss.str());
 
+    oss.str("");
+    oss << "UrlServers: " << nshards;
+    print_strong_log(oss.str());
+
     oss.str("");
     oss << "User-agent: " << user_agent;
     print_strong_log(oss.str());
@@ -143,48 +249,125 @@ int main (int argc, char** argv)
 
   bool status = true;
 
-  TSQueueVector url_queues(nfetchers);
-  TSQueueVector content_queues(nparsers);
+  FetchQueueVector url_queues(nfetchers);
+  ParseRingVector content_queues(nshards);
   MemSec mem_sec(max_ram * MemSec::GB);
+  FetcherRouter router(&url_queues);
+
+  /*
+   * Several Mermoz share the crawl if a 'nodes' file is given
+   */
+  std::unique_ptr<Cluster> cluster;
+  if (!nodes_file.empty()) {
+    cluster.reset(new Cluster(node_id, nodes_file, &mem_sec));
+
+    if (!cluster->load_nodes()) {
+      print_error("This node is not listed within " + nodes_file);
+      return 1;
+    }
+  }
+
+  const bool resume = vmap.count("resume") > 0;
+
+  if (resume && checkpoint_dir.empty()) {
+    print_error("Cannot resume without 'checkpoint-dir' setting");
+    return 1;
+  }
+
+  // the hosts of the shards would be mixed, and a new crawl erases the files
+  std::string ckpt_error;
+  if (resume && !Checkpoint::check(checkpoint_dir, nshards, ckpt_error)) {
+    print_error("Cannot resume, " + ckpt_error);
+    return 1;
+  }
+
+  // a new crawl does not keep the shards of another number of shards
+  if (!resume && !checkpoint_dir.empty())
+    Checkpoint::clear(checkpoint_dir);
 
-  unsigned int queue_id {0};
+  /*
+   * A resumed crawl already knows its frontier
+   */
   std::string link;
-  std::ifstream seedfile(vmap["seeds"].as<std::string>());
-  while (!seedfile.eof()) {
+  std::string seed_meta;
+  CrawlMeta meta;
+  unpack_meta(seed_meta, meta); // depth 0 with all the cash
+  pack_meta(seed_meta, meta);
+  std::ifstream seedfile;
+  if (!resume)
+    seedfile.open(vmap["seeds"].as<std::string>());
+  while (seedfile.is_open() && !seedfile.eof()) {
     link = {""};
     seedfile >> link;
     if (!link.empty()) {
       urlfactory::UrlParser up(link);
-      std::string message;
       std::string host {up.get_host()};
-      pack(message, {&host, &link});
-      url_queues[queue_id].push(message);
-      mem_sec += message.size();
-      queue_id++;
 
-      if (queue_id >= url_queues.size()) {
-        queue_id = 0;
+      if (cluster && !cluster->owns(host)) {
+        // the owner node loads this seed
+        continue;
       }
+
+      std::unique_ptr<FetchTask> task(new FetchTask {host, link, seed_meta, ""});
+      mem_sec += task->size();
+      router.route(host, std::move(task));
     }
   }
   seedfile.close();
 
+  /*
+   * Registrable domains, without the list a domain
+   * is the last two labels of its hosts
+   */
+  urlfactory::PublicSuffix suffixes;
+  if (!suffixes.load(suffix_file))
+    print_warning("Cannot read " + suffix_file + ", domains are guessed");
+
   /* Must initialize libcurl before any threads are started */
   curl_global_init(CURL_GLOBAL_ALL);
 
   /*
    * Settings for the UrlServer
    */
+  RecrawlStats recrawl_stats(nshards);
+  HostReport host_report(nshards);
+  TrapStats trap_stats {{0}, {0}, {0}, {0}};
+  HostReport dust_report(nshards);
+
   UrlServerSettings uset = {
     user_agent,
+    nshards,
+    cluster.get(),
+    checkpoint_dir,
+    checkpoint_interval,
+    resume,
+    weights,
+    recrawl,
+    &recrawl_stats,
+    &host_report,
+    &router,
+    ip_max_fetch,
+    budget,
+    &suffixes,
+    traps,
+    &trap_stats,
+    dust_min,
+    &dust_report,
     &mem_sec
   };
 
-  std::thread userv(urlserver,
-                    &status,
-                    &uset,
-                    &content_queues,
-                    &url_queues);
+  if (cluster)
+    cluster->start(&status, &content_queues);
+
+  std::vector<std::thread> userv;
+  for (unsigned int s_id = 0; s_id < nshards; s_id++) {
+    userv.push_back(std::thread(urlserver,
+                                &status,
+                                s_id,
+                                &uset,
+                                &content_queues.at(s_id),
+                                &url_queues));
+  }
 
   std::atomic<uint64_t> nfetched;
   nfetched = 0;
@@ -195,6 +378,20 @@ int main (int argc, char** argv)
   /*
    * Settings for the Spider
    */
+  ParseStats parse_stats {{}, {}, {}, {}, {0}, {0}, {0}, {0}, {0}, {0}, {0}, {0},
+                          std::vector<std::atomic<uint64_t>>(nparsers),
+                          std::vector<std::atomic<uint64_t>>(nparsers)};
+
+  // pages already fetched under another URL are not parsed
+  ContentSet contents(&mem_sec);
+
+  // and those close to a page already parsed have less important links
+  std::unique_ptr<NearDupIndex> neardups;
+  if (simhash_bits > 0) {
+    neardups.reset(new NearDupIndex(simhash_bits, simhash_mb << 20));
+    mem_sec += neardups->memory();
+  }
+
   SpiderSettings sset = {
     nfetchers,
     nparsers,
@@ -202,6 +399,13 @@ int main (int argc, char** argv)
     &nfetched,
     &nparsed,
     &mem_sec,
+    &router,
+    content_dedup ? &contents : nullptr,
+    neardups.get(),
+    parse_mode,
+    parse_limits,
+    send_text,
+    &parse_stats
   };
 
   std::thread spdr(spider,
@@ -212,7 +416,30 @@ int main (int argc, char** argv)
 
   std::ofstream ofp("log.out");
 
-  ofp << "# time urls contents fetched parsed mem(MB)" << std::endl;
+  ofp << "# time urls contents fetched parsed mem(MB) cpu(s) forwarded received rejected"
+         " tracked refreshed changed freshness affine fallback duplicates near_duplicates"
+         " trap_repeat trap_depth trap_throttled trap_patterns" << std::endl;
+
+  std::ofstream cfp;
+  if (cluster) {
+    cfp.open("cluster.out");
+    cfp << "# time node sent_links sent_bytes recv_links recv_bytes" << std::endl;
+  }
+
+  std::ofstream hfp("hosts.out");
+  hfp << "# time shard host block window in_flight deferred latency(ms) baseline(ms)"
+         " ok throttled timeouts reason" << std::endl;
+
+  std::ofstream pfp("parse.out");
+  pfp << "# time stage pages per time within [2^i, 2^(i+1)) us, i = 0 to "
+      << Histogram::num_buckets - 1 << std::endl;
+  pfp << "# time links found_by_tree found_by_scan found_by_both" << std::endl;
+  pfp << "# time arena parser high_water(KB) held(KB)" << std::endl;
+  pfp << "# time budget over_bytes over_nodes over_depth over_time" << std::endl;
+  pfp << "# time stolen pages_taken_from_another_parser" << std::endl;
+
+  std::ofstream dfp("dust.out");
+  dfp << "# time shard host argument same differ hits" << std::endl;
 
   while (status) {
     sleep(10);
@@ -234,14 +461,104 @@ int main (int argc, char** argv)
     ofp << wait_content << " ";
     ofp << nfetched << " ";
     ofp << nparsed << " ";
-    ofp << mem_sec.get_mem()/(1UL << 20) << std::endl;
+    ofp << mem_sec.get_mem()/(1UL << 20) << " ";
+
+    /*
+     * CPU time consumed by all the threads, compared to the
+     * 'parsed' column it shows where the cores are spent
+     */
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    ofp << usage.ru_utime.tv_sec + usage.ru_stime.tv_sec << " ";
+
+    if (cluster) {
+      ofp << cluster->forwarded() << " ";
+      ofp << cluster->received() << " ";
+      ofp << cluster->rejected() << " ";
+
+      std::ostringstream oss;
+      cluster->report(oss);
+
+      std::istringstream iss(oss.str());
+      while (std::getline(iss, line))
+        cfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " " << line << std::endl;
+    } else {
+      ofp << "0 0 0 ";
+    }
+
+    /*
+     * Pages tracked for recrawl, how many were fetched again
+     * and changed, and the expected share still up to date
+     */
+    ofp << recrawl_stats.num_tracked() << " ";
+    ofp << recrawl_stats.refreshed << " ";
+    ofp << recrawl_stats.changed << " ";
+    ofp << recrawl_stats.freshness() << " ";
+
+    // URLs fetched by the fetcher of their host, or by another one
+    ofp << router.affine() << " ";
+    ofp << router.fallback() << " ";
+
+    // pages not parsed, their content was fetched under another URL
+    ofp << contents.duplicates() << " ";
+    ofp << (neardups ? neardups->near_duplicates() : 0) << " ";
+
+    // URLs dropped as traps, as many fetches saved
+    ofp << trap_stats.repeat << " ";
+    ofp << trap_stats.depth << " ";
+    ofp << trap_stats.throttled << " ";
+    ofp << trap_stats.patterns << std::endl;
+
+    host_report.write(hfp, std::to_string(tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec));
+    hfp.flush();
+
+    // time of the tree building and of its walk per page
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " tree ";
+    parse_stats.tree.write(pfp);
+    pfp << std::endl;
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " walk ";
+    parse_stats.walk.write(pfp);
+    pfp << std::endl;
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " scan ";
+    parse_stats.scan.write(pfp);
+    pfp << std::endl;
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " wait ";
+    parse_stats.wait.write(pfp);
+    pfp << std::endl;
+
+    if (parse_mode == PARSE_COMPARE)
+      pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " links "
+          << parse_stats.dom_links << " "
+          << parse_stats.scan_links << " "
+          << parse_stats.common_links << std::endl;
+
+    // pages whose links were scanned since out of their budget
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " budget "
+        << parse_stats.over_bytes << " "
+        << parse_stats.over_nodes << " "
+        << parse_stats.over_depth << " "
+        << parse_stats.over_time << std::endl;
+    pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " stolen "
+        << parse_stats.stolen << std::endl;
+
+    // memory of the trees, the largest page of each parser
+    if (parse_mode != PARSE_SCAN)
+      for (unsigned int p_id = 0; p_id < nparsers; p_id++)
+        pfp << tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec << " arena " << p_id << " "
+            << parse_stats.arena_high[p_id]/(1UL << 10) << " "
+            << parse_stats.arena_held[p_id]/(1UL << 10) << std::endl;
+    pfp.flush();
+
+    dust_report.write(dfp, std::to_string(tm.tm_hour*3600 + tm.tm_min*60 + tm.tm_sec));
+    dfp.flush();
   }
 
 # ifdef MMZ_PROFILE
   HeapProfilerStop();
 # endif
 
-  userv.join();
+  for (auto& t : userv)
+    t.join();
   spdr.join();
 
   return 0;
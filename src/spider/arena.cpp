@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/arena.hpp"
+
+#include <algorithm>
+
+namespace mermoz
+{
+
+Arena::Arena(size_t block_size, size_t keep) :
+  block_size(block_size),
+  keep(keep),
+  current(0),
+  offset(0),
+  total(0),
+  used(0),
+  high(0)
+{
+}
+
+void* Arena::allocate(size_t size)
+{
+  size = (size + alignment - 1) & ~(alignment - 1);
+  used += size;
+
+  while (current < blocks.size()) {
+    Block& block = blocks[current];
+    if (offset + size <= block.size) {
+      void* ptr = block.data.get() + offset;
+      offset += size;
+      return ptr;
+    }
+
+    // the rest of this block is lost until the next page
+    current++;
+    offset = 0;
+  }
+
+  // 'new' gives memory aligned for any type
+  size_t new_size = std::max(block_size, size);
+  blocks.push_back({std::unique_ptr<char[]>(new char[new_size]), new_size});
+  total += new_size;
+
+  current = blocks.size() - 1;
+  offset = size;
+  return blocks.back().data.get();
+}
+
+void Arena::reset()
+{
+  high = std::max(high, used);
+  used = 0;
+  current = 0;
+  offset = 0;
+
+  while (total > keep && blocks.size() > 1) {
+    total -= blocks.back().size;
+    blocks.pop_back();
+  }
+}
+
+void* Arena::gumbo_allocate(void* userdata, size_t size)
+{
+  return static_cast<Arena*>(userdata)->allocate(size);
+}
+
+void Arena::gumbo_deallocate(void* userdata, void* ptr)
+{
+  (void)userdata;
+  (void)ptr;
+}
+
+} // namespace mermoz
@@ -0,0 +1,98 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_ARENA_H__
+#define MERMOZ_ARENA_H__
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace mermoz
+{
+
+/*! \brief Bump allocator of a parser thread, emptied after each page
+ *
+ * Memory is taken from blocks of 'block_size' bytes (or larger for a
+ * larger request) which are kept from one page to the next, nothing is
+ * freed one by one. 'reset' only rewinds to the first block, and gives
+ * back the blocks above 'keep' bytes a huge page made.
+ */
+class Arena
+{
+public:
+  Arena(size_t block_size = 1UL << 20, size_t keep = 64UL << 20);
+
+  void* allocate(size_t size);
+
+  /*! Forgets every allocation, in O(1) unless blocks are given back */
+  void reset();
+
+  /*! Bytes held by the blocks */
+  size_t capacity() const
+  {
+    return total;
+  }
+
+  /*! Most bytes used by one page */
+  size_t high_water() const
+  {
+    return high;
+  }
+
+  /*
+   * 'GumboOptions' hooks, 'userdata' is the arena,
+   * gumbo frees nothing by itself
+   */
+  static void* gumbo_allocate(void* userdata, size_t size);
+  static void gumbo_deallocate(void* userdata, void* ptr);
+
+private:
+  typedef struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  } Block;
+
+  static const size_t alignment {16};
+
+  size_t block_size;
+  size_t keep;
+
+  std::vector<Block> blocks;
+  size_t current; // block in use
+  size_t offset; // within the current block
+
+  size_t total;
+  size_t used; // by the current page
+  size_t high;
+}; // class Arena
+
+} // namespace mermoz
+
+#endif // MERMOZ_ARENA_H__
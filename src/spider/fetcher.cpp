@@ -33,8 +33,12 @@
 namespace mermoz
 {
 
-void fetcher(thread_safe::queue<std::string>* url_queue,
-             thread_safe::queue<std::string>* content_queue,
+void fetcher(unsigned int fetcher_id,
+             thread_safe::queue<std::unique_ptr<FetchTask>>* url_queue,
+             ParserPool* pool,
+             ParseRingVector* parsed_queues,
+             ContentSet* contents,
+             FetcherRouter* router,
              std::string user_agent,
              std::atomic<uint64_t>* nfetched,
              MemSec* mem_sec,
@@ -42,32 +46,74 @@ void fetcher(thread_safe::queue<std::string>* url_queue,
 {
   std::signal(SIGPIPE, SIG_IGN);
 
+  std::vector<LinkBatchWriter> no_links;
+  ParsedBatches pending(parsed_queues->size());
+
   while (*do_fetch)
   {
-    std::string message;
-    url_queue->pop(message);
-    (*mem_sec) -= message.size();
+    std::unique_ptr<FetchTask> task;
+    url_queue->pop(task);
+    (*mem_sec) -= task->size();
 
-    std::string host;
-    std::string url;
-    unpack(message, {&host, &url});
+    std::string& host = task->host;
+    std::string& url = task->url;
+    std::string& meta = task->meta;
+    std::string& ip = task->ip; // resolved by the dispatcher
 
     std::string content;
     std::string eff_url;
+    FetchInfo info;
+    StreamHash hash;
 
 #   ifdef MMZ_PROFILE
-    long http_code = http_fetch(url, eff_url, content, 60L, user_agent);
+    long http_code = http_fetch(url, eff_url, content, 60L, user_agent, &info, ip, &hash);
 #   else
-    long http_code = http_fetch(url, eff_url, content, 10L, user_agent);
+    long http_code = http_fetch(url, eff_url, content, 10L, user_agent, &info, ip, &hash);
 #   endif
 
-    std::string http_code_string(std::to_string(http_code));
+    /*
+     * Time to the first byte in ms, it tells the dispatcher
+     * how loaded the host is whatever the page size
+     */
+    double first_byte = info.first_byte_time > 0.0 ? info.first_byte_time : info.total_time;
+    long latency = static_cast<long>(first_byte*1000.0);
+
+    /*
+     * The digest tells the recrawl scheduler whether the page
+     * changed, a page already seen under another URL is not parsed
+     */
+    uint64_t digest {0};
+    uint64_t first {0};
+    bool duplicate {false};
+
+    if (http_code >= 200 && http_code < 300) {
+      Digest128 d {0, 0};
+      if (!content.empty())
+        d = hash.digest();
+      digest = d.h1;
+
+      duplicate = contents != nullptr && !content.empty()
+                  && !contents->insert(d, fnv1a(url), first);
+    }
 
-    message.clear();
-    pack(message, {&url, &eff_url, &http_code_string, &content});
+    if (duplicate) {
+      ParseResult page {url, eff_url, http_code, "", "", host, meta, digest,
+                        latency, content.size(),
+                        // the same URL fetched again is not an alias
+                        first == fnv1a(url) ? 0 : first};
+      send_parsed(page, no_links, pending, mem_sec);
+      flush_parsed(pending, parsed_queues);
+    } else {
+      // the page is moved, never copied
+      std::unique_ptr<FetchResult> result(new FetchResult {
+        std::move(url), std::move(eff_url), http_code,
+        std::move(content), std::move(host), std::move(meta),
+        latency, digest});
 
-    (*mem_sec) += message.size();
-    content_queue->push(message);
+      (*mem_sec) += result->size();
+      pool->push(std::move(result));
+    }
+    router->done(fetcher_id);
 
     ++(*nfetched);
   }
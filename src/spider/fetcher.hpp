@@ -41,12 +41,23 @@
 
 #include "tsafe/thread_safe_queue.h"
 #include "common/common.hpp"
+#include "spider/router.hpp"
+#include "spider/parser.hpp"
 
 namespace mermoz
 {
 
-void fetcher(thread_safe::queue<std::string>* url_queue,
-             thread_safe::queue<std::string>* content_queue,
+/*
+ * Pages are moved to the parsers within 'pool'. Those whose content
+ * is within 'contents' skip the parsers, they go to the urlserver
+ * shards through 'parsed_queues' as aliases
+ */
+void fetcher(unsigned int fetcher_id,
+             thread_safe::queue<std::unique_ptr<FetchTask>>* url_queue,
+             ParserPool* pool,
+             ParseRingVector* parsed_queues,
+             ContentSet* contents,
+             FetcherRouter* router,
              std::string user_agent,
              std::atomic<uint64_t>* nfetched,
              MemSec* mem_sec,
@@ -0,0 +1,328 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/linkscan.hpp"
+
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace mermoz
+{
+
+typedef std::vector<std::pair<std::string, std::string>> Attributes;
+
+/*
+ * First '<' within [p, end), or 'end'
+ */
+static const char* find_lt(const char* p, const char* end)
+{
+#ifdef __SSE2__
+  const __m128i lt = _mm_set1_epi8('<');
+
+  for (; p + 16 <= end; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, lt));
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+
+  const void* lt_pos = std::memchr(p, '<', end - p);
+  return lt_pos == nullptr ? end : static_cast<const char*>(lt_pos);
+}
+
+static inline char lower(char c)
+{
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static inline bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/*
+ * True if [p, end) starts with 'word' (lower case), whatever the case
+ */
+static bool starts_with(const char* p, const char* end, const char* word)
+{
+  for (; *word != '\0'; p++, word++)
+    if (p >= end || lower(*p) != *word)
+      return false;
+  return true;
+}
+
+/*
+ * Position of the end tag 'close' ("</script") or 'end'
+ */
+static const char* find_close(const char* p, const char* end, const char* close)
+{
+  while ((p = find_lt(p, end)) < end) {
+    if (starts_with(p, end, close))
+      return p;
+    p++;
+  }
+  return end;
+}
+
+static void append_utf8(std::string& out, unsigned long cp)
+{
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  } else {
+    out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  }
+}
+
+/*
+ * Appends [p, end) to 'out' with the character references decoded,
+ * only the numeric ones and the few named ones met within URLs
+ */
+static void decode(const char* p, const char* end, std::string& out)
+{
+  static const std::pair<const char*, char> named[] = {
+    {"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}
+  };
+
+  while (p < end) {
+    const char* amp = static_cast<const char*>(std::memchr(p, '&', end - p));
+    if (amp == nullptr) {
+      out.append(p, end);
+      return;
+    }
+
+    out.append(p, amp);
+    p = amp + 1;
+
+    if (p < end && *p == '#') {
+      const bool hex = p + 1 < end && lower(p[1]) == 'x';
+      const char* first = p + (hex ? 2 : 1);
+      std::string digits(first, std::min<size_t>(end - first, 8));
+
+      char* num_end;
+      unsigned long cp = 0;
+      const unsigned char digit = digits.empty() ? 0 : static_cast<unsigned char>(digits[0]);
+      if (hex ? std::isxdigit(digit) : std::isdigit(digit))
+        cp = std::strtoul(digits.c_str(), &num_end, hex ? 16 : 10);
+
+      if (cp > 0 && cp <= 0x10ffff) {
+        append_utf8(out, cp);
+        p = first + (num_end - digits.c_str());
+        if (p < end && *p == ';')
+          p++;
+        continue;
+      }
+    } else {
+      bool found = false;
+      for (auto& entity : named)
+        if (starts_with(p, end, entity.first)) {
+          out.push_back(entity.second);
+          p += std::strlen(entity.first);
+          found = true;
+          break;
+        }
+      if (found)
+        continue;
+    }
+
+    out.push_back('&');
+  }
+}
+
+/*
+ * Reads the attributes of a tag from its name end up to its '>',
+ * names are lower case and values decoded, returns the next position
+ */
+static const char* read_attributes(const char* p, const char* end, Attributes& attrs)
+{
+  attrs.clear();
+
+  while (p < end) {
+    while (p < end && (is_space(*p) || *p == '/'))
+      p++;
+
+    if (p >= end)
+      break;
+    if (*p == '>')
+      return p + 1;
+
+    const char* name = p++;
+    while (p < end && !is_space(*p) && *p != '/' && *p != '>' && *p != '=')
+      p++;
+
+    attrs.emplace_back(std::string(), std::string());
+    for (const char* c = name; c < p; c++)
+      attrs.back().first.push_back(lower(*c));
+
+    while (p < end && is_space(*p))
+      p++;
+    if (p >= end || *p != '=')
+      continue;
+
+    p++;
+    while (p < end && is_space(*p))
+      p++;
+
+    const char* value = p;
+    if (p < end && (*p == '"' || *p == '\'')) {
+      const char* quote = static_cast<const char*>(std::memchr(p + 1, *p, end - p - 1));
+      value = p + 1;
+      p = quote == nullptr ? end : quote;
+      decode(value, p, attrs.back().second);
+      if (p < end)
+        p++;
+    } else {
+      while (p < end && !is_space(*p) && *p != '>')
+        p++;
+      decode(value, p, attrs.back().second);
+    }
+  }
+
+  return end;
+}
+
+/*
+ * Value of the first attribute 'name', or nullptr
+ */
+static const std::string* attribute(const Attributes& attrs, const char* name)
+{
+  for (auto& attr : attrs)
+    if (attr.first.compare(name) == 0)
+      return &attr.second;
+  return nullptr;
+}
+
+/*
+ * True if the space separated list 'value' has one of the 'words'
+ */
+static bool has_word(const std::string& value, std::initializer_list<const char*> words)
+{
+  size_t beg = 0;
+  while (beg < value.size()) {
+    size_t stop = beg;
+    while (stop < value.size() && !is_space(value[stop]))
+      stop++;
+
+    for (auto word : words)
+      if (stop - beg == std::strlen(word)
+          && starts_with(value.data() + beg, value.data() + stop, word))
+        return true;
+
+    beg = stop + 1;
+  }
+  return false;
+}
+
+void scan_links(const std::string& html, PageContent& page)
+{
+  page.properties.clear();
+  page.text.clear();
+  page.links.clear();
+
+  const char* p = html.data();
+  const char* end = p + html.size();
+
+  Attributes attrs;
+
+  while ((p = find_lt(p, end)) < end) {
+    p++;
+
+    if (starts_with(p, end, "!--")) {
+      const char* close = static_cast<const char*>(memmem(p + 3, end - p - 3, "-->", 3));
+      p = close == nullptr ? end : close + 3;
+      continue;
+    }
+
+    // doctype, processing instructions and end tags have no links
+    if (p >= end || !((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')))
+      continue;
+
+    const char* name = p;
+    while (p < end && !is_space(*p) && *p != '/' && *p != '>')
+      p++;
+    const size_t name_size = p - name;
+
+    p = read_attributes(p, end, attrs);
+
+    auto is = [&](const char* tag) {
+      return name_size == std::strlen(tag) && starts_with(name, end, tag);
+    };
+
+    const std::string* href;
+    const std::string* rel;
+
+    if (is("a")) {
+      if ((href = attribute(attrs, "href")) != nullptr
+          && ((rel = attribute(attrs, "rel")) == nullptr || rel->compare("nofollow") != 0))
+        page.links.push_back(*href);
+    } else if (is("link")) {
+      if ((href = attribute(attrs, "href")) != nullptr
+          && (rel = attribute(attrs, "rel")) != nullptr
+          && has_word(*rel, {"alternate", "next", "prev"}))
+        page.links.push_back(*href);
+    } else if (is("base")) {
+      if ((href = attribute(attrs, "href")) != nullptr)
+        page.properties.emplace("base", *href);
+    } else if (is("meta")) {
+      const std::string* meta_name = attribute(attrs, "name");
+      const std::string* content = attribute(attrs, "content");
+      if (meta_name != nullptr && content != nullptr && meta_name->compare("description") == 0)
+        page.properties.emplace("description", *content);
+    } else if (is("script")) {
+      p = find_close(p, end, "</script");
+    } else if (is("style")) {
+      p = find_close(p, end, "</style");
+    } else if (is("title")) {
+      const char* close = find_close(p, end, "</title");
+      std::string title;
+      decode(p, close, title);
+      page.properties.emplace("title", title);
+      p = close;
+    }
+  }
+}
+
+} // namespace mermoz
@@ -0,0 +1,50 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_LINKSCAN_H__
+#define MERMOZ_LINKSCAN_H__
+
+#include <string>
+
+#include "spider/parser.hpp"
+
+namespace mermoz
+{
+
+/*
+ * Fills 'page' from the raw HTML without building a tree: the
+ * 'href' of the followed '<a>', the '<link>' to other versions of
+ * the page ('alternate', 'next', 'prev'), the first '<base>' and the
+ * '<meta>' description. Comments, scripts and styles are skipped,
+ * '<' are searched 16 bytes at once with SSE2. The text stays empty.
+ */
+void scan_links(const std::string& html, PageContent& page);
+
+} // namespace mermoz
+
+#endif // MERMOZ_LINKSCAN_H__
@@ -32,271 +32,492 @@
 
 #include "spider/parser.hpp"
 
+#include <chrono>
+#include <unordered_set>
+
+#include "spider/linkscan.hpp"
+
 namespace mermoz
 {
 
-void parser(thread_safe::queue<std::string>* content_queue,
-            thread_safe::queue<std::string>* parsed_queue,
+static uint64_t since(std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point stop)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+}
+
+/*
+ * Distinct links found by the tree walk, by the
+ * scanner, and by both of them
+ */
+static void compare_links(const std::vector<std::string>& dom,
+                          const std::vector<std::string>& scan,
+                          ParseStats* stats)
+{
+  std::unordered_set<std::string> dom_links(dom.begin(), dom.end());
+  std::unordered_set<std::string> scan_links(scan.begin(), scan.end());
+
+  uint64_t common {0};
+  for (auto& link : scan_links)
+    common += dom_links.count(link);
+
+  stats->dom_links += dom_links.size();
+  stats->scan_links += scan_links.size();
+  stats->common_links += common;
+}
+
+void parser(unsigned int parser_id,
+            ParserPool* pool,
+            ParseRingVector* parsed_queues,
+            ParseMode mode,
+            ParseLimits limits,
+            bool send_text,
+            NearDupIndex* neardups,
+            ParseStats* stats,
             std::atomic<uint64_t>* nparsed,
             MemSec* mem_sec,
             bool* status)
 {
+  const unsigned int num_shards = parsed_queues->size();
+
+  std::vector<LinkBatchWriter> batches(num_shards);
+  ParsedBatches pending(num_shards);
+  size_t num_pending {0};
+  PageContent walked;
+  PageContent scanned;
+
+  /*
+   * Nodes, attributes and buffers of the tree come from the arena,
+   * nothing is freed one by one, the whole tree is dropped at once
+   */
+  Arena arena;
+  GumboOptions options = kGumboDefaultOptions;
+  options.allocator = Arena::gumbo_allocate;
+  options.deallocator = Arena::gumbo_deallocate;
+  options.userdata = &arena;
+  options.max_errors = 0; // not read, thus not recorded
+  size_t held {0}; // counted by 'mem_sec'
+
   while (*status)
   {
-    std::string message;
-    content_queue->pop(message);
-    (*mem_sec) -= message.size();
+    std::unique_ptr<FetchResult> fetched;
+    uint64_t wait_us;
+    bool stolen;
+
+    // the results are pushed once enough, or when no page waits
+    if (!pool->pop(parser_id, fetched, wait_us, stolen, num_pending > 0 ? 0L : 1000L)) {
+      flush_parsed(pending, parsed_queues);
+      num_pending = 0;
+      continue;
+    }
+
+    (*mem_sec) -= fetched->size();
+    stats->wait.add(wait_us);
+    if (stolen)
+      stats->stolen++;
+
+    ParseResult page;
+    page.url = std::move(fetched->url);
+    page.eff_url = std::move(fetched->eff_url);
+    page.http_status = fetched->http_status;
+    page.host = std::move(fetched->host);
+    page.meta = std::move(fetched->meta);
+    page.latency = fetched->latency;
+    page.digest = fetched->digest;
+
+    // freed with 'fetched' once the page is parsed
+    const std::string& content = fetched->content;
+    long http_code = page.http_status;
 
-    std::string url;
-    std::string eff_url;
-    std::string content;
-    std::string http_status;
-    unpack(message, {&url, &eff_url, &http_status, &content});
+    for (auto& batch : batches)
+      batch.clear();
 
-    message.clear();
-    long http_code = atoi(http_status.c_str());
+    page.content_size = content.size();
+    bool near_dup {false};
 
     if (http_code >= 200 && http_code < 300)
     {
-      GumboOutput* output = gumbo_parse(content.c_str());
+      // the links of the pages out of their budget come from a scan
+      bool over {false};
+
+      if (mode != PARSE_SCAN && limits.max_bytes > 0 && content.size() > limits.max_bytes)
+      {
+        walked.properties.clear();
+        walked.text.clear();
+        walked.links.clear();
+
+        stats->over_bytes++;
+        over = true;
+      }
+      else if (mode != PARSE_SCAN)
+      {
+        auto start = std::chrono::steady_clock::now();
+        GumboOutput* output = gumbo_parse_with_options(&options, content.data(), content.size());
+        auto parsed = std::chrono::steady_clock::now();
+
+        // the text is at most the page, the buffer is kept between pages
+        walked.text.reserve(content.size());
+        WalkEnd end = walk_page(output->root, walked, limits, start);
+
+        stats->tree.add(since(start, parsed));
+        stats->walk.add(since(parsed, std::chrono::steady_clock::now()));
+
+        // instead of 'gumbo_destroy_output'
+        arena.reset();
+
+        if (arena.capacity() > held)
+          (*mem_sec) += arena.capacity() - held;
+        else
+          (*mem_sec) -= held - arena.capacity();
+        held = arena.capacity();
+
+        stats->arena_high[parser_id] = arena.high_water();
+        stats->arena_held[parser_id] = arena.capacity();
+
+        switch (end) {
+          case WALK_DEPTH: stats->over_depth++; break;
+          case WALK_NODES: stats->over_nodes++; break;
+          case WALK_TIME: stats->over_time++; break;
+          default: break;
+        }
+        over = end != WALK_DONE;
+
+        // same article with another sidebar, and so on, a truncated text is not the page
+        uint64_t hash;
+        if (!over && neardups != nullptr && simhash(walked.text, hash))
+          near_dup = neardups->check_insert(hash, fnv1a(page.url));
+
+        /**
+         * The exploration alone does not need the clear
+         * text, it is only sent for indexing
+         */
+        if (send_text)
+          page.text.assign(walked.text);
+      }
 
-      std::map<std::string, std::string> page_properties =
-        get_page_properties(output->root);
+      if (mode != PARSE_DOM || over)
+      {
+        auto start = std::chrono::steady_clock::now();
+        scan_links(content, scanned);
+        stats->scan.add(since(start, std::chrono::steady_clock::now()));
+      }
 
-      std::string text = get_text(output->root);
-      text_cleaner(text);
+      if (mode == PARSE_COMPARE && !over)
+        compare_links(walked.links, scanned.links, stats);
 
-      std::string raw_links = get_links(output->root);
-      std::string formated_urls;
+      PageContent& found = mode == PARSE_SCAN || over ? scanned : walked;
 
       std::string base;
-      auto mapit = page_properties.end();
+      auto mapit = found.properties.end();
 
-      if ((mapit = page_properties.find("base")) != page_properties.end()) {
+      if ((mapit = found.properties.find("base")) != found.properties.end()) {
         urlfactory::UrlParser up_base(mapit->second);
         if (up_base.complete()) {
           base = up_base.get_url();
         } else {
-          urlfactory::UrlParser up_eff(eff_url);
+          urlfactory::UrlParser up_eff(page.eff_url);
           up_base += up_eff;
           base = up_base.get_url();
         }
       } else {
-        base = eff_url;
+        base = page.eff_url;
       }
 
-      url_formating(base, raw_links, formated_urls);
-      raw_links.clear();
-
-      /**
-       * For now on we just test the exploration
-       * mechanism, clear text is deleted
-       */
-      text.clear();
-      /**
-       * To remove if you need data for indexing
-       */
-
-      pack(message, {&url, &eff_url, &http_status, &text, &formated_urls});
-
-      gumbo_destroy_output(&kGumboDefaultOptions, output);
+      url_formating(base, found.links, batches);
     }
     else
     {
-      std::string text, links;
-      pack(message, {&url, &eff_url, &http_status, &text, &links});
+      page.digest = 0;
     }
 
-    (*mem_sec) += message.size();
-    parsed_queue->push(message);
+    /*
+     * The links are one step deeper and share
+     * the cash of their page (OPIC)
+     */
+    CrawlMeta meta;
+    unpack_meta(page.meta, meta);
+
+    size_t num_links = 0;
+    for (auto& batch : batches)
+      num_links += batch.size();
+
+    meta.depth++;
+    if (num_links > 0)
+      meta.cash /= num_links;
+    if (near_dup)
+      meta.cash *= NearDupIndex::link_cash;
+
+    page.meta.clear();
+    pack_meta(page.meta, meta);
+
+    num_pending += send_parsed(page, batches, pending, mem_sec);
+    pool->done(parser_id);
+
+    if (num_pending >= parsed_batch_size) {
+      flush_parsed(pending, parsed_queues);
+      num_pending = 0;
+    }
 
     ++(*nparsed);
   }
+
+  flush_parsed(pending, parsed_queues);
 }
 
-std::string get_text(GumboNode* node)
+size_t send_parsed(ParseResult& page,
+                   std::vector<LinkBatchWriter>& batches,
+                   ParsedBatches& pending,
+                   MemSec* mem_sec)
 {
-  if (node->type == GUMBO_NODE_TEXT)
-  {
-    return std::string(node->v.text.text);
-  }
-  else if (node->type == GUMBO_NODE_ELEMENT &&
-           node->v.element.tag != GUMBO_TAG_SCRIPT &&
-           node->v.element.tag != GUMBO_TAG_STYLE)
-  {
-    std::string fulltext("");
-    GumboVector* children = &node->v.element.children;
-    for (unsigned int i = 0; i < children->length; ++i)
-    {
-      const std::string text = get_text(static_cast<GumboNode*>(children->data[i]));
-      if (i != 0 && !text.empty())
-      {
-        fulltext.append(" ");
-      }
-      fulltext.append(text);
+  const unsigned int num_shards = pending.size();
+  size_t num_results {0};
+
+  /*
+   * Each shard receives its own links, 'url' and 'eff_url'
+   * are only sent to the shard owning their host
+   */
+  const unsigned int url_shard =
+    host_shard(urlfactory::UrlParser(page.url).get_host(), num_shards);
+  const unsigned int eff_shard = page.eff_url.empty() ? url_shard :
+    host_shard(urlfactory::UrlParser(page.eff_url).get_host(), num_shards);
+
+  if (!page.eff_url.empty())
+    page.host = urlfactory::UrlParser(page.eff_url).get_host();
+
+  for (unsigned int s_id = 0; s_id < num_shards; s_id++) {
+    if (s_id != url_shard
+        && s_id != eff_shard
+        && (s_id >= batches.size() || batches[s_id].empty()))
+      continue;
+
+    std::unique_ptr<ParseResult> result(new ParseResult);
+    if (s_id < batches.size())
+      batches[s_id].write(result->links);
+
+    if (s_id == url_shard) {
+      // one shard owns 'url', its fields are not copied
+      result->url = std::move(page.url);
+      result->text = std::move(page.text);
+      result->digest = page.digest;
+      result->latency = page.latency;
+      result->content_size = page.content_size;
+      result->alias = page.alias;
     }
-    return fulltext;
-  }
-  else
-  {
-    return "";
-  }
-}
 
-std::map<std::string, std::string> get_page_properties(GumboNode* root)
-{
-  std::map<std::string, std::string> page_properties;
+    if (s_id == eff_shard)
+      result->eff_url = page.eff_url;
 
-  if (!(root->type == GUMBO_NODE_ELEMENT)
-      || !(root->v.element.children.length >= 2))
-    return page_properties;
+    result->http_status = page.http_status;
+    result->host = page.host;
+    result->meta = page.meta;
 
-  const GumboVector* root_children = &root->v.element.children;
-  GumboNode* head = nullptr;
-  for (unsigned int i = 0; i < root_children->length; ++i)
-  {
-    GumboNode* child = static_cast<GumboNode*>(root_children->data[i]);
-    if (child->type == GUMBO_NODE_ELEMENT &&
-        child->v.element.tag == GUMBO_TAG_HEAD)
-    {
-      head = child;
-      break;
-    }
+    (*mem_sec) += result->size();
+    pending[s_id].push_back(std::move(result));
+    num_results++;
   }
 
-  if (head == nullptr)
-    return page_properties;
+  return num_results;
+}
 
-  GumboVector* head_children = &head->v.element.children;
-  for (unsigned int i = 0; i < head_children->length; ++i)
-  {
-    GumboNode* child = static_cast<GumboNode*>(head_children->data[i]);
-    if (child->type == GUMBO_NODE_ELEMENT)
-    {
-      if(child->v.element.tag == GUMBO_TAG_TITLE)
-      {
-        if (child->v.element.children.length == 1)
-        {
-          GumboNode* title_text = static_cast<GumboNode*>(child->v.element.children.data[0]);
-          page_properties.emplace("title", title_text->v.text.text);
-        }
-      }
-      else if (child->v.element.tag == GUMBO_TAG_BASE)
-      {
-        GumboAttribute* href;
-        if ((href = gumbo_get_attribute(&child->v.element.attributes, "href")) != nullptr)
-          page_properties.emplace("base", href->value);
-      }
-      else if (child->v.element.tag == GUMBO_TAG_META)
-      {
-        GumboAttribute* name;
-        if ((name = gumbo_get_attribute(&child->v.element.attributes, "name")) != nullptr)
-        {
-          if (std::strcmp(name->value, "description") == 0)
-          {
-            GumboAttribute* content;
-            if ((content = gumbo_get_attribute(&child->v.element.attributes, "content")) != nullptr)
-              page_properties.emplace("description", content->value);
-          }
-        }
-      }
+void flush_parsed(ParsedBatches& pending, ParseRingVector* parsed_queues)
+{
+  for (unsigned int s_id = 0; s_id < pending.size(); s_id++) {
+    std::vector<std::unique_ptr<ParseResult>>& results = pending[s_id];
+    ParseRing& ring = parsed_queues->at(s_id);
+
+    // a full ring takes none, the blocking push waits for room
+    for (size_t done = 0; done < results.size();) {
+      size_t n = ring.try_push_batch(results.data() + done, results.size() - done);
+      if (n == 0)
+        ring.push(std::move(results[done++]));
+      done += n;
     }
-  }
 
-  return page_properties;
+    results.clear();
+  }
 }
 
-std::string get_links(GumboNode* node)
+/*
+ * Node being walked, 'sep' is the size of the text before the space
+ * put ahead of it, taken back if the node gives no text
+ */
+typedef struct WalkFrame {
+  GumboNode* node;
+  unsigned int next; // child to walk
+  size_t sep;
+  uint64_t text_mark; // text bytes met before the node
+  bool text; // its text is kept
+  bool links; // its links are kept
+  bool head; // the head of the page
+} WalkFrame;
+
+static void head_property(GumboNode* child, std::map<std::string, std::string>& properties)
 {
-  if (node->type != GUMBO_NODE_ELEMENT)
+  if (child->v.element.tag == GUMBO_TAG_TITLE)
   {
-    return "";
+    if (child->v.element.children.length == 1)
+    {
+      GumboNode* title_text = static_cast<GumboNode*>(child->v.element.children.data[0]);
+      if (title_text->type != GUMBO_NODE_ELEMENT)
+        properties.emplace("title", title_text->v.text.text);
+    }
   }
-  GumboAttribute* href;
-  if (node->v.element.tag == GUMBO_TAG_A &&
-      (href = gumbo_get_attribute(&node->v.element.attributes, "href")))
+  else if (child->v.element.tag == GUMBO_TAG_BASE)
   {
-    GumboAttribute* rel = gumbo_get_attribute(&node->v.element.attributes, "rel");
-
-    if (rel == nullptr) {
-      return std::string(href->value);
-    } else if (std::strcmp(rel->value, "nofollow") != 0) {
-      /*
-       * We check the 'nofollow' rule
-       */
-      return std::string(href->value);
-    }
+    GumboAttribute* href;
+    if ((href = gumbo_get_attribute(&child->v.element.attributes, "href")) != nullptr)
+      properties.emplace("base", href->value);
   }
-
-  std::string links("");
-
-  GumboVector* children = &node->v.element.children;
-  for (unsigned int i = 0; i < children->length; ++i)
+  else if (child->v.element.tag == GUMBO_TAG_META)
   {
-    std::string link = get_links(static_cast<GumboNode*>(children->data[i]));
-    if (i != 0 && !link.empty())
+    GumboAttribute* name;
+    if ((name = gumbo_get_attribute(&child->v.element.attributes, "name")) != nullptr)
     {
-      while (*link.begin() == '\n' && !link.empty())
+      if (std::strcmp(name->value, "description") == 0)
       {
-        link.erase(link.begin());
+        GumboAttribute* content;
+        if ((content = gumbo_get_attribute(&child->v.element.attributes, "content")) != nullptr)
+          properties.emplace("description", content->value);
       }
-      links.append("\n");
     }
-    links.append(link);
   }
-
-  return links;
 }
 
-void text_cleaner (std::string& s)
+WalkEnd walk_page(GumboNode* root,
+                  PageContent& page,
+                  const ParseLimits& limits,
+                  std::chrono::steady_clock::time_point start)
 {
-  auto it = s.begin();
+  page.properties.clear();
+  page.text.clear();
+  page.links.clear();
+
+  if (root->type != GUMBO_NODE_ELEMENT)
+    return WALK_DONE;
+
+  WalkEnd end = WALK_DONE;
+  uint64_t nodes = 0;
 
-  while (it != s.end())
+  // the head is searched among the children of the root
+  bool head_found = root->v.element.children.length < 2;
+
+  // bytes of the text nodes kept, whitespaces included
+  uint64_t text_bytes = 0;
+
+  std::vector<WalkFrame> stack;
+  stack.push_back({root, 0, std::string::npos, 0,
+                   root->v.element.tag != GUMBO_TAG_SCRIPT
+                   && root->v.element.tag != GUMBO_TAG_STYLE,
+                   true, false});
+
+  while (!stack.empty())
   {
-    if (*it == '\t')
-      *it = ' ';
+    WalkFrame& frame = stack.back();
+    GumboVector* children = &frame.node->v.element.children;
 
-    if (*it == ' ' && *(it+1) == ' ')
+    if (frame.next >= children->length)
     {
-      it = s.erase(it);
+      // an element without text takes back the space put before it
+      if (frame.sep != std::string::npos && text_bytes == frame.text_mark)
+        page.text.resize(frame.sep);
+      stack.pop_back();
+      continue;
     }
-    else if (*it == ' ' && *(it+1) == '\n')
+
+    const unsigned int i = frame.next++;
+    GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+
+    if (child->type == GUMBO_NODE_TEXT)
     {
-      it = s.erase(it);
+      const size_t size = frame.text ? std::strlen(child->v.text.text) : 0;
+      if (size > 0)
+      {
+        if (i != 0)
+          append_collapsed(page.text, " ", 1);
+        append_collapsed(page.text, child->v.text.text, size);
+        text_bytes += size;
+      }
+      continue;
     }
-    else if (*it == '\n' && *(it+1) == ' ')
+
+    if (child->type != GUMBO_NODE_ELEMENT)
+      continue;
+
+    GumboElement* element = &child->v.element;
+
+    if (limits.max_nodes > 0 && ++nodes > limits.max_nodes)
+      return WALK_NODES;
+
+    // the clock is read once every 1024 elements
+    if (limits.max_ms > 0 && (nodes & 1023) == 0
+        && since(start, std::chrono::steady_clock::now()) > limits.max_ms*1000)
+      return WALK_TIME;
+
+    if (frame.head)
+      head_property(child, page.properties);
+
+    bool head = false;
+    if (!head_found && frame.node == root && element->tag == GUMBO_TAG_HEAD)
+      head_found = head = true;
+
+    /*
+     * A followed link is not searched for other links,
+     * the 'nofollow' ones are
+     */
+    bool links = frame.links;
+    GumboAttribute* href;
+    if (links && element->tag == GUMBO_TAG_A
+        && (href = gumbo_get_attribute(&element->attributes, "href")))
     {
-      it = s.erase(it+1);
+      GumboAttribute* rel = gumbo_get_attribute(&element->attributes, "rel");
+
+      if (rel == nullptr || std::strcmp(rel->value, "nofollow") != 0) {
+        page.links.emplace_back(href->value);
+        links = false;
+      }
     }
-    else if (*it == '\n' && *(it+1) == '\n')
+
+    bool text = frame.text
+                && element->tag != GUMBO_TAG_SCRIPT
+                && element->tag != GUMBO_TAG_STYLE;
+
+    if (!text && !links && !head)
+      continue;
+
+    if (limits.max_depth > 0 && stack.size() >= limits.max_depth)
     {
-      it = s.erase(it+1);
+      end = WALK_DEPTH;
+      continue;
     }
-    else
+
+    size_t sep = std::string::npos;
+    if (frame.text && i != 0)
     {
-      it++;
+      sep = page.text.size();
+      append_collapsed(page.text, " ", 1);
     }
+
+    // 'frame' is not used after the stack grows
+    stack.push_back({child, 0, sep, text_bytes, text, links, head});
   }
+
+  return end;
 }
 
-void url_formating(std::string& base, std::string& raw_urls, std::string& formated_urls)
+void url_formating(const std::string& base,
+                   const std::vector<std::string>& raw_urls,
+                   std::vector<LinkBatchWriter>& batches)
 {
-  formated_urls.clear();
+  for (auto& batch : batches)
+    batch.clear();
 
   if (raw_urls.empty())
     return;
 
   urlfactory::UrlParser baseup(base);
 
-  std::istringstream iss(raw_urls);
-  std::string link;
-
-  while (!iss.eof())
+  for (auto& link : raw_urls)
   {
-    link.clear();
-    std::getline(iss, link);
-
     if (link.size() > 1)
     {
       if (link.find("javascript") == std::string::npos
@@ -314,18 +535,13 @@ void url_formating(std::string& base, std::string& raw_urls, std::string& format
           /*
            * Do not follow links with fragment, it is the same page...
            */
-          formated_urls.append(up.get_url(true, true, true, true, false)).append("\n");
+          std::string host {up.get_host()};
+          batches[host_shard(host, batches.size())]
+            .add(up.get_url(true, true, true, true, false), host);
         }
       }
     }
-    else
-    {
-      continue;
-    }
   }
-
-  if (!formated_urls.empty())
-    formated_urls.pop_back(); // removes last \n
 }
 
 } // namespace mermoz
@@ -34,12 +34,14 @@
 #define MERMOZ_PARSER_H__
 
 #include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
 #include <cstring>
 #include <atomic>
+#include <chrono>
 #include <map>
 
 #include "gumbo.h"
@@ -47,25 +49,149 @@
 #include "tsafe/thread_safe_queue.h"
 
 #include "common/common.hpp"
+#include "spider/simhash.hpp"
+#include "spider/arena.hpp"
+#include "spider/parserpool.hpp"
+#include "spider/whitespace.hpp"
 
 namespace mermoz
 {
 
-void parser(thread_safe::queue<std::string>* content_queue,
-            thread_safe::queue<std::string>* parsed_queue,
+/*
+ * How the links are found: within the tree built by gumbo, which gives
+ * the text too, by scanning the raw HTML, or both ways to compare them
+ */
+enum ParseMode {
+  PARSE_DOM,
+  PARSE_SCAN,
+  PARSE_COMPARE
+};
+
+/*
+ * Budgets of a page, 0 disables each one. Pages above 'max_bytes' are
+ * not given to gumbo, the walk of a tree stops past 'max_nodes' elements
+ * or 'max_ms' since the page was taken, and skips the elements deeper
+ * than 'max_depth'. The links of such pages are then found by a scan.
+ */
+typedef struct ParseLimits {
+  size_t max_bytes;
+  uint64_t max_nodes;
+  unsigned int max_depth;
+  uint64_t max_ms;
+} ParseLimits;
+
+/*
+ * How the walk of a tree ended, the first budget spent
+ */
+enum WalkEnd {
+  WALK_DONE,
+  WALK_DEPTH, // deeper elements were skipped
+  WALK_NODES,
+  WALK_TIME
+};
+
+/*
+ * Time spent per page, shared by the parsers
+ */
+typedef struct ParseStats {
+  Histogram tree; // gumbo_parse
+  Histogram walk; // walk_page
+  Histogram scan; // scan_links
+  Histogram wait; // within the pool
+
+  // distinct links per page, summed, when comparing
+  std::atomic<uint64_t> dom_links;
+  std::atomic<uint64_t> scan_links;
+  std::atomic<uint64_t> common_links;
+
+  // pages out of their budgets, per reason
+  std::atomic<uint64_t> over_bytes;
+  std::atomic<uint64_t> over_nodes;
+  std::atomic<uint64_t> over_depth;
+  std::atomic<uint64_t> over_time;
+
+  // pages taken from the deque of another parser
+  std::atomic<uint64_t> stolen;
+
+  // per parser, bytes of its arena used by its largest page and held
+  std::vector<std::atomic<uint64_t>> arena_high;
+  std::vector<std::atomic<uint64_t>> arena_held;
+} ParseStats;
+
+/*
+ * 'parsed_queues' holds one queue per urlserver shard,
+ * links are routed to the shard owning their host. The
+ * links of the pages 'neardups' knows get less cash, it
+ * needs the text thus not used by 'PARSE_SCAN'. The trees
+ * of gumbo are built within an arena of the parser, the pages
+ * out of 'limits' only keep the text walked before. The text
+ * is only sent with 'send_text'. Pages are taken from the deque
+ * of 'parser_id' within 'pool', or stolen
+ */
+void parser(unsigned int parser_id,
+            ParserPool* pool,
+            ParseRingVector* parsed_queues,
+            ParseMode mode,
+            ParseLimits limits,
+            bool send_text,
+            NearDupIndex* neardups,
+            ParseStats* stats,
             std::atomic<uint64_t>* nparsed,
             MemSec* mem_sec,
             bool* status);
 
-std::map<std::string, std::string> get_page_properties(GumboNode* node);
+/*
+ * Results waiting to be pushed by batches, one vector per urlserver shard
+ */
+typedef std::vector<std::vector<std::unique_ptr<ParseResult>>> ParsedBatches;
+
+// results a parser gathers before pushing them
+static const size_t parsed_batch_size {32};
+
+/*
+ * Adds 'page' and the links of 'batches', one per shard, to the
+ * results pending for the urlserver shards, 'eff_url' goes to the
+ * shard of its host. The fields only sent to the shard of 'url'
+ * are moved from 'page'. Returns the number of results added
+ */
+size_t send_parsed(ParseResult& page,
+                   std::vector<LinkBatchWriter>& batches,
+                   ParsedBatches& pending,
+                   MemSec* mem_sec);
 
-std::string get_text(GumboNode* node);
+/*
+ * Pushes the results of 'pending' to their shards by batches,
+ * waits while a ring is full
+ */
+void flush_parsed(ParsedBatches& pending, ParseRingVector* parsed_queues);
 
-std::string get_links(GumboNode* node);
+/*
+ * What the parser keeps of a page
+ */
+typedef struct PageContent {
+  std::map<std::string, std::string> properties; // 'title', 'base' and 'description' of the head
+  std::string text; // without scripts and styles, whitespaces collapsed
+  std::vector<std::string> links; // 'href' of the followed links
+} PageContent;
 
-void text_cleaner(std::string& s);
+/*
+ * Fills 'page' within one walk of the tree, with an explicit
+ * stack since deep pages would overflow the recursion. The
+ * walk stops when 'limits' are spent, 'start' is the time the
+ * parsing of the page began
+ */
+WalkEnd walk_page(GumboNode* root,
+                  PageContent& page,
+                  const ParseLimits& limits,
+                  std::chrono::steady_clock::time_point start);
 
-void url_formating(std::string& rool_url, std::string& raw_urls, std::string& formated_urls);
+/*
+ * Normalizes the 'raw_urls' found within a page of URL 'base',
+ * each one is added to the batch of the shard owning its host
+ */
+void url_formating(const std::string& base,
+                   const std::vector<std::string>& raw_urls,
+                   std::vector<LinkBatchWriter>& batches);
 
 } // namespace mermoz
 
@@ -0,0 +1,163 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/parserpool.hpp"
+
+namespace mermoz
+{
+
+ParserPool::ParserPool(unsigned int num_parsers)
+{
+  for (unsigned int i = 0; i < num_parsers; i++)
+    workers.emplace_back(new Worker());
+}
+
+void ParserPool::push(std::unique_ptr<FetchResult>&& page)
+{
+  const unsigned int num_workers = workers.size();
+  const unsigned int first = next++ % num_workers;
+
+  unsigned int best = first;
+  uint64_t best_load = UINT64_MAX;
+
+  for (unsigned int i = 0; i < num_workers; i++) {
+    const unsigned int cur = (first + i) % num_workers;
+    const uint64_t load = workers[cur]->queued_bytes + workers[cur]->busy_bytes;
+    if (load < best_load) {
+      best = cur;
+      best_load = load;
+    }
+  }
+
+  Worker& worker = *workers[best];
+  {
+    boost::lock_guard<boost::mutex> lock(worker.mutex);
+    const size_t size = page->size();
+    worker.queued_bytes += size;
+    worker.tasks.push_back({std::move(page), size, std::chrono::steady_clock::now()});
+  }
+  waiting++;
+
+  {
+    boost::lock_guard<boost::mutex> lock(idle_mutex);
+    pushes++;
+  }
+  idle.notify_one();
+}
+
+bool ParserPool::take_from(Worker& worker,
+                           unsigned int parser_id,
+                           std::unique_ptr<FetchResult>& page,
+                           uint64_t& wait_us)
+{
+  uint64_t size;
+  std::chrono::steady_clock::time_point queued;
+  {
+    boost::lock_guard<boost::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+      return false;
+
+    page = std::move(worker.tasks.front().page);
+    size = worker.tasks.front().size;
+    queued = worker.tasks.front().queued;
+    worker.tasks.pop_front();
+
+    worker.queued_bytes -= size;
+  }
+  waiting--;
+
+  workers[parser_id]->busy_bytes = size;
+  wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - queued).count();
+  return true;
+}
+
+bool ParserPool::take(unsigned int parser_id,
+                      std::unique_ptr<FetchResult>& page,
+                      uint64_t& wait_us,
+                      bool& stolen)
+{
+  stolen = false;
+  if (take_from(*workers[parser_id], parser_id, page, wait_us))
+    return true;
+
+  // the victim is the parser with the most bytes waiting
+  while (waiting > 0) {
+    Worker* victim = nullptr;
+    uint64_t most = 0;
+    for (auto& worker : workers) {
+      const uint64_t bytes = worker->queued_bytes;
+      if (bytes > most) {
+        victim = worker.get();
+        most = bytes;
+      }
+    }
+
+    if (victim == nullptr)
+      return false;
+
+    if (take_from(*victim, parser_id, page, wait_us)) {
+      stolen = victim != workers[parser_id].get();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ParserPool::pop(unsigned int parser_id,
+                     std::unique_ptr<FetchResult>& page,
+                     uint64_t& wait_us,
+                     bool& stolen,
+                     long time_ms)
+{
+  uint64_t seen;
+  {
+    boost::lock_guard<boost::mutex> lock(idle_mutex);
+    seen = pushes;
+  }
+
+  if (take(parser_id, page, wait_us, stolen))
+    return true;
+
+  {
+    boost::unique_lock<boost::mutex> lock(idle_mutex);
+    if (!idle.timed_wait(lock, boost::posix_time::milliseconds(time_ms),
+                         [&]() { return pushes != seen; }))
+      return false;
+  }
+
+  return take(parser_id, page, wait_us, stolen);
+}
+
+void ParserPool::done(unsigned int parser_id)
+{
+  workers[parser_id]->busy_bytes = 0;
+}
+
+} // namespace mermoz
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_PARSERPOOL_H__
+#define MERMOZ_PARSERPOOL_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <boost/thread.hpp>
+
+#include "common/messages.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Pages waiting for the parsers, one deque per parser
+ *
+ * A page goes to the parser with the fewest bytes waiting or being
+ * parsed, thus not behind a parser busy on a huge page. A parser takes
+ * the oldest page of its deque, and once empty it steals the oldest one
+ * of the parser with the most bytes waiting.
+ */
+class ParserPool
+{
+public:
+  ParserPool(unsigned int num_parsers);
+
+  void push(std::unique_ptr<FetchResult>&& page);
+
+  /*! Takes the next page of 'parser_id', waits at most 'time_ms'
+   *
+   * \param wait_us Time the page waited within the pool
+   * \param stolen True if the page was placed on another parser
+   */
+  bool pop(unsigned int parser_id,
+           std::unique_ptr<FetchResult>& page,
+           uint64_t& wait_us,
+           bool& stolen,
+           long time_ms);
+
+  /*! 'parser_id' is done with the page it took */
+  void done(unsigned int parser_id);
+
+  /*! Pages waiting */
+  size_t size() const
+  {
+    return waiting;
+  }
+
+private:
+  typedef struct Task {
+    std::unique_ptr<FetchResult> page;
+    size_t size;
+    std::chrono::steady_clock::time_point queued;
+  } Task;
+
+  typedef struct Worker {
+    boost::mutex mutex;
+    std::deque<Task> tasks;
+    std::atomic<uint64_t> queued_bytes {0};
+    std::atomic<uint64_t> busy_bytes {0}; // of the page being parsed
+  } Worker;
+
+  bool take(unsigned int parser_id, std::unique_ptr<FetchResult>& page, uint64_t& wait_us, bool& stolen);
+  bool take_from(Worker& worker, unsigned int parser_id, std::unique_ptr<FetchResult>& page, uint64_t& wait_us);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<unsigned int> next {0}; // first one tried, ties are spread
+  std::atomic<size_t> waiting {0};
+
+  // the idle parsers sleep there
+  boost::mutex idle_mutex;
+  boost::condition_variable idle;
+  uint64_t pushes {0};
+}; // class ParserPool
+
+} // namespace mermoz
+
+#endif // MERMOZ_PARSERPOOL_H__
@@ -0,0 +1,88 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/router.hpp"
+
+#include <cmath>
+
+namespace mermoz
+{
+
+FetcherRouter::FetcherRouter(FetchQueueVector* url_queues, float load_factor) :
+  url_queues(url_queues),
+  load_factor(load_factor),
+  load(url_queues->size()),
+  total_load(0),
+  num_affine(0),
+  num_fallback(0)
+{
+  for (unsigned int f_id = 0; f_id < url_queues->size(); f_id++)
+    ring.add_node(f_id);
+}
+
+unsigned int FetcherRouter::route(const std::string& host, std::unique_ptr<FetchTask>&& task)
+{
+  const size_t num_fetchers = load.size();
+
+  // the bound counts the URL being routed
+  long bound = static_cast<long>(std::ceil(load_factor
+                                           * (total_load + 1)
+                                           / num_fetchers));
+
+  std::vector<unsigned int> candidates;
+  ring.walk(host, num_candidates, candidates);
+
+  unsigned int f_id = num_fetchers;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (load[candidates[i]] + 1 <= bound) {
+      f_id = candidates[i];
+      if (i == 0)
+        num_affine++;
+      else
+        num_fallback++;
+      break;
+    }
+  }
+
+  if (f_id == num_fetchers) {
+    // every candidate is busy, the least loaded one takes it
+    f_id = 0;
+    for (unsigned int id = 1; id < num_fetchers; id++)
+      if (load[id] < load[f_id])
+        f_id = id;
+    num_fallback++;
+  }
+
+  load[f_id]++;
+  total_load++;
+  url_queues->at(f_id).push(std::move(task));
+
+  return f_id;
+}
+
+} // namespace mermoz
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_ROUTER_H__
+#define MERMOZ_ROUTER_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "common/messages.hpp"
+#include "cluster/cluster.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Chooses the fetcher of an URL
+ *
+ * A host always goes to the same fetcher, so it reuses its connections,
+ * unless this fetcher is loaded above 'load_factor' times the mean load
+ * (consistent hashing with bounded loads). The next fetchers around the
+ * ring are then tried, and at last the least loaded one. The load of a
+ * fetcher is its queued URLs plus the one being fetched.
+ */
+class FetcherRouter
+{
+public:
+  FetcherRouter(FetchQueueVector* url_queues, float load_factor = 1.25f);
+
+  /*! Moves the 'task' of an URL of 'host' to a fetcher queue */
+  unsigned int route(const std::string& host, std::unique_ptr<FetchTask>&& task);
+
+  /*! A fetcher is done with one of its URLs */
+  void done(unsigned int fetcher_id)
+  {
+    load[fetcher_id]--;
+    total_load--;
+  }
+
+  /*! URLs sent to the fetcher of their host, and to another one */
+  uint64_t affine()
+  {
+    return num_affine;
+  }
+
+  uint64_t fallback()
+  {
+    return num_fallback;
+  }
+
+  // fetchers tried around the ring before the least loaded one
+  static const size_t num_candidates {3};
+
+private:
+  FetchQueueVector* url_queues;
+  const float load_factor;
+
+  HashRing ring;
+
+  std::vector<std::atomic<long>> load;
+  std::atomic<long> total_load;
+
+  std::atomic<uint64_t> num_affine;
+  std::atomic<uint64_t> num_fallback;
+}; // class FetcherRouter
+
+} // namespace mermoz
+
+#endif // MERMOZ_ROUTER_H__
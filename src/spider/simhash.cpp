@@ -0,0 +1,153 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/simhash.hpp"
+
+#include <algorithm>
+
+#include "common/hashing.hpp"
+
+namespace mermoz
+{
+
+static inline uint64_t mix(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  return k;
+}
+
+bool simhash(const std::string& text, uint64_t& hash)
+{
+  std::vector<uint64_t> words;
+
+  size_t beg {0};
+  for (size_t i = 0; i <= text.size(); i++)
+    if (i == text.size() || text[i] == ' ' || text[i] == '\n') {
+      if (i > beg)
+        words.push_back(fnv1a(text.data() + beg, i - beg));
+      beg = i + 1;
+    }
+
+  if (words.size() < NearDupIndex::shingle_size + NearDupIndex::min_shingles)
+    return false;
+
+  int counts[64] = {0};
+
+  for (size_t i = 0; i + NearDupIndex::shingle_size <= words.size(); i++) {
+    uint64_t shingle {words[i]};
+    for (size_t j = 1; j < NearDupIndex::shingle_size; j++)
+      shingle = ((shingle << 17) | (shingle >> 47)) ^ words[i + j];
+    shingle = mix(shingle);
+
+    for (unsigned int b = 0; b < 64; b++)
+      counts[b] += (shingle >> b) & 1 ? 1 : -1;
+  }
+
+  hash = 0;
+  for (unsigned int b = 0; b < 64; b++)
+    if (counts[b] > 0)
+      hash |= 1ULL << b;
+
+  return true;
+}
+
+NearDupIndex::NearDupIndex(unsigned int max_bits, size_t max_mem) :
+  max_bits(max_bits),
+  num_bands(max_bits + 1),
+  band_bits(64/(max_bits + 1)),
+  num_buckets(1024),
+  stripes(new std::mutex[num_stripes]),
+  num_near(0)
+{
+  while (2*num_buckets*num_bands*bucket_size*sizeof(Slot) <= max_mem)
+    num_buckets *= 2;
+
+  bucket_shift = 64 - __builtin_ctzll(num_buckets);
+  buckets.assign(num_buckets*num_bands*bucket_size, Slot {0, 0});
+}
+
+size_t NearDupIndex::bucket(unsigned int band, uint64_t hash) const
+{
+  uint64_t value = (hash >> (band*band_bits)) & ((1ULL << band_bits) - 1);
+  return band*num_buckets
+         + (((value + band)*0x9e3779b97f4a7c15ULL) >> bucket_shift);
+}
+
+bool NearDupIndex::check_insert(uint64_t hash, uint64_t url_fp)
+{
+  // 0 marks the free slots
+  if (hash == 0)
+    hash = 1;
+
+  bool near {false};
+
+  for (unsigned int band = 0; band < num_bands; band++) {
+    const size_t b = bucket(band, hash);
+    Slot* slots = &buckets[b*bucket_size];
+
+    std::lock_guard<std::mutex> lock(stripes[b % num_stripes]);
+
+    size_t free_slot {bucket_size};
+    bool known {false};
+
+    for (size_t i = 0; i < bucket_size; i++) {
+      if (slots[i].hash == 0) {
+        free_slot = std::min(free_slot, i);
+        continue;
+      }
+
+      // the previous version of the same page
+      if (slots[i].url_fp == url_fp) {
+        slots[i].hash = hash;
+        known = true;
+        continue;
+      }
+
+      if (static_cast<unsigned int>(__builtin_popcountll(slots[i].hash ^ hash)) <= max_bits)
+        near = true;
+      known = known || slots[i].hash == hash;
+    }
+
+    if (known)
+      continue;
+
+    // a full bucket forgets one of its hashes
+    if (free_slot == bucket_size)
+      free_slot = mix(hash + band) % bucket_size;
+    slots[free_slot] = {hash, url_fp};
+  }
+
+  if (near)
+    num_near++;
+
+  return near;
+}
+
+} // namespace mermoz
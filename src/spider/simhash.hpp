@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_SIMHASH_H__
+#define MERMOZ_SIMHASH_H__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace mermoz
+{
+
+/*
+ * 64 bits SimHash of the shingles of 'shingle_size' words of 'text',
+ * returns false if the text is too short to be compared
+ */
+bool simhash(const std::string& text, uint64_t& hash);
+
+/*! \brief Finds the pages within 'max_bits' of a SimHash, shared by the parsers
+ *
+ * Hashes are split into 'max_bits + 1' bands, two hashes within 'max_bits'
+ * have at least one equal band. Each band has a table of buckets of four
+ * hashes with the fingerprint of their URL (one cache line) indexed by the
+ * band value, a full bucket forgets one of its hashes so the memory stays
+ * bounded. Buckets are locked by stripes, the parsers query the index
+ * together.
+ */
+class NearDupIndex
+{
+public:
+  NearDupIndex(unsigned int max_bits, size_t max_mem);
+
+  /*! Adds 'hash' of the page of 'url_fp', returns true if another
+   * page within 'max_bits' was known, a page fetched again replaces
+   * its previous hash and is not compared with it
+   */
+  bool check_insert(uint64_t hash, uint64_t url_fp);
+
+  uint64_t near_duplicates() const
+  {
+    return num_near;
+  }
+
+  size_t memory() const
+  {
+    return buckets.size()*sizeof(Slot);
+  }
+
+  // share of the cash of a near duplicate given to its links
+  static constexpr float link_cash {0.01f};
+
+  static const size_t shingle_size {4};
+  static const size_t min_shingles {16};
+
+private:
+  typedef struct Slot {
+    uint64_t hash;
+    uint64_t url_fp;
+  } Slot;
+
+  static const size_t bucket_size {4};
+  static const size_t num_stripes {256};
+
+  size_t bucket(unsigned int band, uint64_t hash) const;
+
+  unsigned int max_bits;
+  unsigned int num_bands;
+  unsigned int band_bits;
+  unsigned int bucket_shift;
+  size_t num_buckets; // per band
+
+  std::vector<Slot> buckets; // band after band
+  std::unique_ptr<std::mutex[]> stripes;
+  std::atomic<uint64_t> num_near;
+}; // class NearDupIndex
+
+} // namespace mermoz
+
+#endif // MERMOZ_SIMHASH_H__
@@ -39,44 +39,22 @@ namespace mermoz
 
 void spider(bool* status, // defines if thread runs or not
             SpiderSettings* ssets, // general settings
-            TSQueueVector* url_queues, // incomming data
-            TSQueueVector* content_queues) // outcomming data
+            FetchQueueVector* url_queues, // incomming data
+            ParseRingVector* content_queues) // outcomming data
 {
-  TSQueueVector out_fetch(ssets->num_threads_fetchers);
+  // the fetchers give their pages to the parsers directly
+  ParserPool pool(ssets->num_threads_parsers);
+
   std::vector<std::thread> fetchers;
 
   for (unsigned int f_id = 0; f_id < ssets->num_threads_fetchers; f_id++) {
-    fetchers.push_back(std::thread(fetcher, &url_queues->at(f_id), &out_fetch.at(f_id), ssets->user_agent, ssets->nfetched, ssets->mem_sec, status));
+    fetchers.push_back(std::thread(fetcher, f_id, &url_queues->at(f_id), &pool, content_queues, ssets->contents, ssets->router, ssets->user_agent, ssets->nfetched, ssets->mem_sec, status));
   }
 
-  TSQueueVector in_parse(ssets->num_threads_parsers);
   std::vector<std::thread> parsers;
 
   for (unsigned int p_id = 0; p_id < ssets->num_threads_parsers; p_id++) {
-    parsers.push_back(std::thread(parser, &in_parse.at(p_id), &content_queues->at(p_id), ssets->nparsed, ssets->mem_sec, status));
-  }
-
-  /*
-   * Funnel function
-   */
-  unsigned int fetcher_id {0};
-  unsigned int parser_id {0};
-  while (*status) {
-    if (!out_fetch.at(fetcher_id).empty()) {
-      std::string tmp;
-      out_fetch.at(fetcher_id).pop(tmp);
-      in_parse.at(parser_id).push(tmp);
-
-      parser_id++;
-      if (parser_id >= ssets->num_threads_parsers) {
-        parser_id = 0;
-      }
-    }
-
-    fetcher_id++;
-    if (fetcher_id >= ssets->num_threads_fetchers) {
-      fetcher_id = 0;
-    }
+    parsers.push_back(std::thread(parser, p_id, &pool, content_queues, ssets->parse_mode, ssets->parse_limits, ssets->send_text, ssets->neardups, ssets->parse_stats, ssets->nparsed, ssets->mem_sec, status));
   }
 
   for (auto& t : fetchers)
@@ -31,12 +31,10 @@
 
 #include <atomic>
 
-#include "tsafe/thread_safe_queue.h"
-
+#include "common/messages.hpp"
 #include "spider/fetcher.hpp"
 #include "spider/parser.hpp"
-
-using TSQueueVector = std::vector<thread_safe::queue<std::string>>;
+#include "spider/router.hpp"
 
 namespace mermoz
 {
@@ -48,6 +46,13 @@ typedef struct SpiderSettings {
   std::atomic<uint64_t>* nfetched;
   std::atomic<uint64_t>* nparsed;
   MemSec* mem_sec;
+  FetcherRouter* router; // told when a fetcher is done with an URL
+  ContentSet* contents; // digests of the pages fetched, nullptr if not deduplicated
+  NearDupIndex* neardups; // SimHash of the pages parsed, nullptr if not used
+  ParseMode parse_mode;
+  ParseLimits parse_limits; // per page
+  bool send_text; // the clear text goes with the links, for indexing
+  ParseStats* parse_stats;
 } SpiderSettings;
 
 
@@ -57,8 +62,8 @@ typedef struct SpiderSettings {
  */
 void spider(bool* status, // defines if thread runs or not
             SpiderSettings* sset, // general settings
-            TSQueueVector* url_queues, // incomming data
-            TSQueueVector* content_queues); // outcomming data
+            FetchQueueVector* url_queues, // incomming data
+            ParseRingVector* content_queues); // outcomming data, one per urlserver shard
 
 } // namespace mermoz
 
@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "spider/whitespace.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace mermoz
+{
+
+static inline bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+/*
+ * Collapses 'text' from 'w', the end of what is written,
+ * returns the new end. 'w' never goes past 'text'
+ */
+static inline char* collapse(const char* text, size_t size, char* w, const char* beg)
+{
+  for (size_t i = 0; i < size; i++) {
+    const char c = text[i];
+
+    if (!is_space(c)) {
+      *w++ = c;
+    } else if (w == beg || (w[-1] != ' ' && w[-1] != '\n')) {
+      *w++ = c == '\n' ? '\n' : ' ';
+    } else if (c == '\n') {
+      w[-1] = '\n'; // the run has a newline
+    }
+  }
+
+  return w;
+}
+
+void append_collapsed_scalar(std::string& out, const char* text, size_t size)
+{
+  const size_t used = out.size();
+  out.resize(used + size);
+
+  char* beg = &out[0];
+  char* w = collapse(text, size, beg + used, beg);
+
+  out.resize(w - beg);
+}
+
+void append_collapsed(std::string& out, const char* text, size_t size)
+{
+#ifdef __SSE2__
+  const size_t used = out.size();
+  out.resize(used + size);
+
+  char* beg = &out[0];
+  char* w = beg + used;
+
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                              _mm_or_si128(_mm_cmpeq_epi8(chunk, tab),
+                                           _mm_cmpeq_epi8(chunk, newline)));
+
+    if (_mm_movemask_epi8(ws) == 0) {
+      // 'w' is at most 'i' bytes after 'used', the 16 bytes fit
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(w), chunk);
+      w += 16;
+    } else {
+      w = collapse(text + i, 16, w, beg);
+    }
+  }
+
+  w = collapse(text + i, size - i, w, beg);
+
+  out.resize(w - beg);
+#else
+  append_collapsed_scalar(out, text, size);
+#endif
+}
+
+} // namespace mermoz
@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_WHITESPACE_H__
+#define MERMOZ_WHITESPACE_H__
+
+#include <string>
+
+namespace mermoz
+{
+
+/*
+ * Appends 'text' to 'out' with its whitespaces collapsed on the fly:
+ * a run of spaces, tabs and newlines becomes one newline if it has
+ * one, one space otherwise, runs going on from the end of 'out' too.
+ * Linear, chunks of 16 bytes without whitespace are copied with SSE2.
+ */
+void append_collapsed(std::string& out, const char* text, size_t size);
+
+/*
+ * Same on the fly collapsing without SIMD, the
+ * fallback of the machines without SSE2
+ */
+void append_collapsed_scalar(std::string& out, const char* text, size_t size);
+
+} // namespace mermoz
+
+#endif // MERMOZ_WHITESPACE_H__
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2018 Qwant Research
+ * The source code is licenced under MIT Licence that can be found in the
+ * LICENCE file in the root directory of Mermoz
+ *
+ * Author:
+ * Noel Martin <n.martin@qwantresearch.com>
+ */
+
+#ifndef THREAD_SAFE_NOTIFIER_INCLUDED
+#define THREAD_SAFE_NOTIFIER_INCLUDED
+
+#include <boost/thread.hpp>
+
+namespace thread_safe {
+
+/*
+ * Event counter shared by several containers, a consumer
+ * reads 'count()' before scanning its queues and then waits
+ * for the counter to move, thus no push can be missed.
+ */
+class notifier {
+public:
+    notifier( void ) : events( 0 ) { }
+
+    unsigned long long count( void ) const { boost::lock_guard<boost::mutex> lock( mutex ); return events; }
+
+    void notify( void ) { { boost::lock_guard<boost::mutex> lock( mutex ); ++events; } cond.notify_all(); }
+
+    void wait( unsigned long long seen )
+    {
+      boost::unique_lock<boost::mutex> lock( mutex );
+      while (events == seen)
+        cond.wait(lock);
+    }
+
+    bool wait_for( unsigned long long seen, long time_ms )
+    {
+      boost::unique_lock<boost::mutex> lock( mutex );
+      return cond.timed_wait(lock, boost::posix_time::milliseconds(time_ms),
+                           [&]() { return events != seen; });
+    }
+
+private:
+    unsigned long long events;
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+};
+
+}
+
+#endif // THREAD_SAFE_NOTIFIER_INCLUDED
@@ -17,15 +17,19 @@
 #include <queue>
 #include <vector>
 #include <deque>
+#include <utility>
 
 #include <boost/thread.hpp>
 
+#include "tsafe/thread_safe_notifier.h"
+
 namespace thread_safe {
 
 template < class T, class Container = std::deque<T> >
 class queue {
 public:
-    explicit queue( const Container & ctnr = Container() ) : storage( ctnr ) { }
+    queue( void ) : watcher( nullptr ) { }
+    explicit queue( const Container & ctnr ) : storage( ctnr ), watcher( nullptr ) { }
     bool empty( void ) const { boost::lock_guard<boost::mutex> lock( mutex ); return storage.empty(); }
 
     size_t size( void ) const { boost::lock_guard<boost::mutex> lock( mutex ); return storage.size(); }
@@ -36,7 +40,37 @@ public:
     T & front( void ) { boost::lock_guard<boost::mutex> lock( mutex ); return storage.front(); }
     const T & front( void ) const { boost::lock_guard<boost::mutex> lock( mutex ); return storage.front(); }
 
-    void push( const T & u ) { boost::lock_guard<boost::mutex> lock( mutex ); storage.push( u ); cond.notify_one(); }
+    void push( const T & u )
+    {
+      notifier* n;
+      {
+        boost::lock_guard<boost::mutex> lock( mutex );
+        storage.push( u );
+        n = watcher;
+      }
+      cond.notify_one();
+      if (n != nullptr)
+        n->notify();
+    }
+
+    void push( T && u )
+    {
+      notifier* n;
+      {
+        boost::lock_guard<boost::mutex> lock( mutex );
+        storage.push( std::move( u ) );
+        n = watcher;
+      }
+      cond.notify_one();
+      if (n != nullptr)
+        n->notify();
+    }
+
+    /*
+     * Every push on this queue will also wake the consumer
+     * waiting on 'n', this is how a thread waits on several queues
+     */
+    void attach( notifier * n ) { boost::lock_guard<boost::mutex> lock( mutex ); watcher = n; }
 
     void pop( void )
     {
@@ -51,16 +85,74 @@ public:
       boost::unique_lock<boost::mutex> lock( mutex );
       while (storage.empty())
         cond.wait(lock);
-      u = storage.front(); 
+      u = std::move( storage.front() ); 
       storage.pop();
     }
 
+    bool try_pop( T & u )
+    {
+      boost::lock_guard<boost::mutex> lock( mutex );
+      if (storage.empty())
+        return false;
+      u = std::move( storage.front() );
+      storage.pop();
+      return true;
+    }
+
+    bool pop_for( T & u, long time_ms )
+    {
+      boost::unique_lock<boost::mutex> lock( mutex );
+      if (!cond.timed_wait(lock, boost::posix_time::milliseconds(time_ms),
+                         [&]() { return !storage.empty(); }))
+        return false;
+      u = std::move( storage.front() );
+      storage.pop();
+      return true;
+    }
+
 private:
     std::queue<T, Container> storage;
     mutable boost::mutex mutex;
     boost::condition_variable cond;
+    notifier* watcher;
 };
 
+/*
+ * 'select' like wait over a vector of queues sharing the notifier 'n',
+ * queues are scanned round-robin from 'id' and the function blocks at most
+ * 'time_ms' if all of them are empty. On success 'id' is the index of
+ * the queue 'u' was popped from.
+ */
+template < class T, class Container >
+bool select( std::vector< queue<T, Container> > & queues, notifier & n, size_t & id, T & u, long time_ms )
+{
+    if (queues.empty())
+      return false;
+
+    unsigned long long seen = n.count();
+
+    for (size_t i = 0; i < queues.size(); i++) {
+      size_t cur = (id + i) % queues.size();
+      if (queues[cur].try_pop( u )) {
+        id = cur;
+        return true;
+      }
+    }
+
+    if (!n.wait_for( seen, time_ms ))
+      return false;
+
+    for (size_t i = 0; i < queues.size(); i++) {
+      size_t cur = (id + i) % queues.size();
+      if (queues[cur].try_pop( u )) {
+        id = cur;
+        return true;
+      }
+    }
+
+    return false;
+}
+
 template < class T, class Container = std::vector<T>, class Compare = std::less<typename Container::value_type> >
 class priority_queue {
 public:
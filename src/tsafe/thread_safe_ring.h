@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2018 Qwant Research
+ * The source code is licenced under MIT Licence that can be found in the
+ * LICENCE file in the root directory of Mermoz
+ *
+ * Author:
+ * Noel Martin <n.martin@qwantresearch.com>
+ */
+
+#ifndef THREAD_SAFE_RING_INCLUDED
+#define THREAD_SAFE_RING_INCLUDED
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <climits>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace thread_safe {
+
+/*
+ * Bounded multi producers multi consumers queue without lock (Dmitry
+ * Vyukov's ring): each cell has a sequence telling whether it waits
+ * for a push or a pop of the current lap, the two positions are only
+ * moved by compare and swap and live on their own cache lines. Items
+ * are moved in and out. A thread finding no item, or no room, spins
+ * a little then sleeps on a futex, also while the next cell is taken
+ * but not yet filled. The other side only touches the futex words
+ * when a thread sleeps.
+ */
+template < class T >
+class ring {
+public:
+    explicit ring( size_t capacity = 1 << 14 ) :
+      mask( round_up( capacity ) - 1 ),
+      cells( new cell[mask + 1] ),
+      push_pos( 0 ), pop_pos( 0 ),
+      pushes( 0 ), pops( 0 ),
+      pop_sleepers( 0 ), push_sleepers( 0 )
+    {
+      for (size_t i = 0; i <= mask; i++)
+        cells[i].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    ring( const ring & ) = delete;
+    ring & operator=( const ring & ) = delete;
+
+    size_t capacity( void ) const { return mask + 1; }
+
+    /* Approximate while pushes and pops are running */
+    size_t size( void ) const
+    {
+      size_t pop = pop_pos.load( std::memory_order_relaxed );
+      size_t push = push_pos.load( std::memory_order_relaxed );
+      return push > pop ? push - pop : 0;
+    }
+
+    bool empty( void ) const { return size() == 0; }
+
+    bool try_push( T && u )
+    {
+      if (!try_push_impl( u ))
+        return false;
+      wake_consumers();
+      return true;
+    }
+
+    /* Blocks while the ring is full */
+    void push( T && u )
+    {
+      for (unsigned int tries = 0; !try_push_impl( u ); tries++)
+        if (tries >= spins)
+          wait_space( 100L );
+      wake_consumers();
+    }
+
+    void push( const T & u ) { T copy( u ); push( std::move( copy ) ); }
+
+    /*
+     * Moves at most 'count' items from 'items', returns how
+     * many, they are contiguous within the ring
+     */
+    size_t try_push_batch( T * items, size_t count )
+    {
+      size_t pos = push_pos.load( std::memory_order_relaxed );
+      size_t n;
+      for (;;) {
+        n = 0;
+        while (n < count && cells[(pos + n) & mask].sequence.load( std::memory_order_acquire ) == pos + n)
+          n++;
+
+        if (n == 0) {
+          cell & c = cells[pos & mask];
+          if (static_cast<intptr_t>(c.sequence.load( std::memory_order_acquire ) - pos) < 0)
+            return 0; // full
+          pos = push_pos.load( std::memory_order_relaxed );
+          continue;
+        }
+
+        if (push_pos.compare_exchange_weak( pos, pos + n, std::memory_order_relaxed ))
+          break;
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        cell & c = cells[(pos + i) & mask];
+        c.data = std::move( items[i] );
+        c.sequence.store( pos + i + 1, std::memory_order_release );
+      }
+      wake_consumers();
+      return n;
+    }
+
+    bool try_pop( T & u )
+    {
+      if (!try_pop_impl( u ))
+        return false;
+      wake_producers();
+      return true;
+    }
+
+    void pop( T & u )
+    {
+      for (unsigned int tries = 0; !try_pop_impl( u ); tries++)
+        if (tries >= spins)
+          wait_items( 100L );
+      wake_producers();
+    }
+
+    bool pop_for( T & u, long time_ms )
+    {
+      for (unsigned int tries = 0; tries < spins; tries++)
+        if (try_pop( u ))
+          return true;
+      wait_items( time_ms );
+      return try_pop( u );
+    }
+
+    /* Appends at most 'count' items to 'items', returns how many */
+    size_t try_pop_batch( std::vector<T> & items, size_t count )
+    {
+      size_t pos = pop_pos.load( std::memory_order_relaxed );
+      size_t n;
+      for (;;) {
+        n = 0;
+        while (n < count && cells[(pos + n) & mask].sequence.load( std::memory_order_acquire ) == pos + n + 1)
+          n++;
+
+        if (n == 0) {
+          cell & c = cells[pos & mask];
+          if (static_cast<intptr_t>(c.sequence.load( std::memory_order_acquire ) - (pos + 1)) < 0)
+            return 0; // empty
+          pos = pop_pos.load( std::memory_order_relaxed );
+          continue;
+        }
+
+        if (pop_pos.compare_exchange_weak( pos, pos + n, std::memory_order_relaxed ))
+          break;
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        cell & c = cells[(pos + i) & mask];
+        items.push_back( std::move( c.data ) );
+        c.data = T();
+        c.sequence.store( pos + i + mask + 1, std::memory_order_release );
+      }
+      wake_producers();
+      return n;
+    }
+
+private:
+    static const size_t cache_line = 64;
+    static const unsigned int spins = 64; // tries before sleeping
+
+    struct cell {
+      std::atomic<size_t> sequence;
+      T data;
+    };
+
+    static size_t round_up( size_t n )
+    {
+      size_t p = 2;
+      while (p < n)
+        p <<= 1;
+      return p;
+    }
+
+    bool try_push_impl( T & u )
+    {
+      size_t pos = push_pos.load( std::memory_order_relaxed );
+      cell * c;
+      for (;;) {
+        c = &cells[pos & mask];
+        intptr_t dif = static_cast<intptr_t>(c->sequence.load( std::memory_order_acquire ) - pos);
+        if (dif == 0) {
+          if (push_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ))
+            break;
+        } else if (dif < 0) {
+          return false;
+        } else {
+          pos = push_pos.load( std::memory_order_relaxed );
+        }
+      }
+      c->data = std::move( u );
+      c->sequence.store( pos + 1, std::memory_order_release );
+      return true;
+    }
+
+    bool try_pop_impl( T & u )
+    {
+      size_t pos = pop_pos.load( std::memory_order_relaxed );
+      cell * c;
+      for (;;) {
+        c = &cells[pos & mask];
+        intptr_t dif = static_cast<intptr_t>(c->sequence.load( std::memory_order_acquire ) - (pos + 1));
+        if (dif == 0) {
+          if (pop_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ))
+            break;
+        } else if (dif < 0) {
+          return false;
+        } else {
+          pos = pop_pos.load( std::memory_order_relaxed );
+        }
+      }
+      u = std::move( c->data );
+      c->data = T(); // the ring does not keep the buffers
+      c->sequence.store( pos + mask + 1, std::memory_order_release );
+      return true;
+    }
+
+    /*
+     * 'pushes' and 'pops' only move to wake sleepers. A sleeper raises
+     * its flag then checks the next cell before sleeping on the value it
+     * read first, the other side fills or frees a cell then takes the
+     * flag and wakes every sleeper, thus once per sleep and not once per
+     * item until they run. The fences order both so a wake is not missed
+     */
+    static void futex_wait( std::atomic<uint32_t> & word, uint32_t seen, long time_ms )
+    {
+      struct timespec ts;
+      ts.tv_sec = time_ms / 1000;
+      ts.tv_nsec = (time_ms % 1000) * 1000000L;
+      syscall( SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, seen, &ts, nullptr, 0 );
+    }
+
+    static void futex_wake( std::atomic<uint32_t> & word, int count )
+    {
+      syscall( SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0 );
+    }
+
+    void wake_consumers( void )
+    {
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if (pop_sleepers.load( std::memory_order_relaxed ) && pop_sleepers.exchange( 0 )) {
+        pushes.fetch_add( 1 );
+        futex_wake( pushes, INT_MAX );
+      }
+    }
+
+    /*
+     * Producers sleep while the ring is full, they are woken once a
+     * quarter of it is free rather than fighting for each freed cell
+     */
+    void wake_producers( void )
+    {
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if (push_sleepers.load( std::memory_order_relaxed )
+          && size() + capacity() / 4 <= capacity()
+          && push_sleepers.exchange( 0 )) {
+        pops.fetch_add( 1 );
+        futex_wake( pops, INT_MAX );
+      }
+    }
+
+    /* The next cell to pop is filled, not only taken by a producer */
+    bool item_ready( void ) const
+    {
+      size_t pos = pop_pos.load( std::memory_order_relaxed );
+      return cells[pos & mask].sequence.load( std::memory_order_acquire ) == pos + 1;
+    }
+
+    /* The next cell to push was emptied by its consumer */
+    bool space_ready( void ) const
+    {
+      size_t pos = push_pos.load( std::memory_order_relaxed );
+      return cells[pos & mask].sequence.load( std::memory_order_acquire ) == pos;
+    }
+
+    void wait_items( long time_ms )
+    {
+      uint32_t seen = pushes.load();
+      pop_sleepers.store( 1 );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if (!item_ready())
+        futex_wait( pushes, seen, time_ms );
+    }
+
+    void wait_space( long time_ms )
+    {
+      uint32_t seen = pops.load();
+      push_sleepers.store( 1 );
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+      if (!space_ready())
+        futex_wait( pops, seen, time_ms );
+    }
+
+    const size_t mask;
+    std::unique_ptr<cell[]> cells;
+
+    alignas(cache_line) std::atomic<size_t> push_pos;
+    alignas(cache_line) std::atomic<size_t> pop_pos;
+    alignas(cache_line) std::atomic<uint32_t> pushes;
+    alignas(cache_line) std::atomic<uint32_t> pops;
+    alignas(cache_line) std::atomic<uint32_t> pop_sleepers; // 1 if a consumer may sleep
+    alignas(cache_line) std::atomic<uint32_t> push_sleepers;
+};
+
+}
+
+#endif // THREAD_SAFE_RING_INCLUDED
@@ -0,0 +1,232 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Qwant Research
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "publicsuffix.hpp"
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <cstring>
+#include <cctype>
+
+namespace urlfactory
+{
+
+/*
+ * Trie used while reading the rules, flattened afterwards
+ */
+typedef struct BuildNode {
+  uint16_t flags {0};
+  std::map<std::string, std::unique_ptr<BuildNode>> children;
+} BuildNode;
+
+bool PublicSuffix::load(const std::string& path)
+{
+  std::ifstream ifs(path);
+  if (!ifs.is_open())
+    return false;
+
+  BuildNode root;
+  std::string line;
+
+  while (std::getline(ifs, line)) {
+    // a rule is the first word of its line
+    size_t end = line.find_first_of(" \t\r");
+    if (end != std::string::npos)
+      line.resize(end);
+
+    if (line.empty() || line.compare(0, 2, "//") == 0)
+      continue;
+
+    uint16_t flags = RULE;
+    if (line[0] == '!') {
+      flags = EXCEPTION;
+      line.erase(0, 1);
+    }
+
+    for (auto& c : line)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    BuildNode* node = &root;
+    size_t stop = line.size();
+    while (true) {
+      size_t dot = line.rfind('.', stop == 0 ? 0 : stop - 1);
+      size_t start = (dot == std::string::npos) ? 0 : dot + 1;
+
+      std::unique_ptr<BuildNode>& next = node->children[line.substr(start, stop - start)];
+      if (!next)
+        next.reset(new BuildNode());
+      node = next.get();
+
+      if (dot == std::string::npos)
+        break;
+      stop = dot;
+    }
+    node->flags |= flags;
+  }
+
+  /*
+   * Breadth first, so the children of
+   * a node are next to each others
+   */
+  nodes.clear();
+  labels.clear();
+  nodes.push_back({0, 0, 0, 0, 0});
+
+  std::queue<std::pair<const BuildNode*, uint32_t>> pending;
+  pending.emplace(&root, 0);
+
+  while (!pending.empty()) {
+    const BuildNode* node = pending.front().first;
+    uint32_t id = pending.front().second;
+    pending.pop();
+
+    nodes[id].first_child = static_cast<uint32_t>(nodes.size());
+    nodes[id].num_children = static_cast<uint32_t>(node->children.size());
+
+    for (auto& c : node->children) {
+      uint32_t child_id = static_cast<uint32_t>(nodes.size());
+      nodes.push_back({0,
+                       0,
+                       static_cast<uint32_t>(labels.size()),
+                       static_cast<uint16_t>(c.first.size()),
+                       c.second->flags});
+      labels.append(c.first);
+      pending.emplace(c.second.get(), child_id);
+    }
+  }
+
+  nodes.shrink_to_fit();
+  labels.shrink_to_fit();
+
+  return true;
+}
+
+const PublicSuffix::Node* PublicSuffix::child(const Node& node,
+                                              const char* label,
+                                              size_t size) const
+{
+  // std::map kept the labels sorted
+  uint32_t low = node.first_child;
+  uint32_t high = node.first_child + node.num_children;
+
+  while (low < high) {
+    uint32_t mid = low + (high - low)/2;
+    const Node& n = nodes[mid];
+
+    int cmp = std::memcmp(labels.data() + n.label_offset, label,
+                          std::min<size_t>(n.label_size, size));
+    if (cmp == 0)
+      cmp = (n.label_size < size) ? -1 : (n.label_size > size ? 1 : 0);
+
+    if (cmp == 0)
+      return &n;
+    else if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return nullptr;
+}
+
+size_t PublicSuffix::suffix_labels(const std::string& host) const
+{
+  if (nodes.empty() || host.empty())
+    return 1;
+
+  // the labels are read from the right, a longer host keeps its end
+  char lower[256];
+  size_t size = std::min(host.size(), sizeof(lower));
+  const size_t offset = host.size() - size;
+  for (size_t i = 0; i < size; i++)
+    lower[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(host[offset + i])));
+
+  // the '*' rule applies when nothing else does
+  size_t suffix {1};
+  const Node* node = &nodes[0];
+
+  size_t stop = size;
+  for (size_t depth = 1; node != nullptr; depth++) {
+    size_t start = stop;
+    while (start > 0 && lower[start - 1] != '.')
+      start--;
+
+    if (child(*node, "*", 1) != nullptr)
+      suffix = std::max(suffix, depth);
+
+    // a label cut by the copy only matches '*'
+    if (start == 0 && offset > 0)
+      break;
+
+    const Node* next = child(*node, lower + start, stop - start);
+    if (next == nullptr)
+      break;
+
+    if (next->flags & EXCEPTION)
+      return depth - 1;
+
+    if (next->flags & RULE)
+      suffix = std::max(suffix, depth);
+
+    if (start == 0)
+      break;
+
+    node = next;
+    stop = start - 1;
+  }
+
+  return suffix;
+}
+
+std::string PublicSuffix::registrable_domain(const std::string& host) const
+{
+  std::string domain(host);
+  for (auto& c : domain)
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+  // IP addresses have no suffix
+  if (domain.find(':') != std::string::npos
+      || domain.find_first_not_of("0123456789.") == std::string::npos)
+    return domain;
+
+  const size_t num_labels = suffix_labels(domain) + 1;
+
+  // 'pos' ends on the dot before the first label of the domain
+  size_t pos = domain.size();
+  for (size_t i = 0; i < num_labels; i++) {
+    if (pos == std::string::npos || pos == 0)
+      return domain; // the host is a public suffix
+    pos = domain.rfind('.', pos - 1);
+  }
+
+  return pos == std::string::npos ? domain : domain.substr(pos + 1);
+}
+
+} // namespace urlfactory
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 Qwant Research
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef URLFACTORY_PUBLICSUFFIX_H__
+#define URLFACTORY_PUBLICSUFFIX_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace urlfactory
+{
+
+/*! \brief Registrable domains from the Public Suffix List
+ *
+ * The rules of 'public_suffix_list.dat' are compiled into a trie over
+ * the labels read from the right. Nodes are stored breadth first in one
+ * array, the children of a node are contiguous and sorted so they are
+ * found by a binary search, and all the labels share one string.
+ * Lookups do not allocate and may run from several threads.
+ */
+class PublicSuffix
+{
+public:
+  PublicSuffix() {}
+
+  /*! Compiles the rules of a Public Suffix List file
+   * \param path 'public_suffix_list.dat'
+   * \return False if the file cannot be read
+   */
+  bool load(const std::string& path);
+
+  bool empty() const
+  {
+    return nodes.empty();
+  }
+
+  /*! Returns the number of labels of the public suffix of 'host',
+   * the last label if no rule matches
+   */
+  size_t suffix_labels(const std::string& host) const;
+
+  /*! Returns the registrable domain of 'host', the public suffix
+   * and one more label, or 'host' itself if it is a suffix or an IP
+   */
+  std::string registrable_domain(const std::string& host) const;
+
+private:
+  enum {
+    RULE = 1, // a rule ends at this label
+    EXCEPTION = 2 // '!' rule, the suffix is its parent
+  };
+
+  typedef struct Node {
+    uint32_t first_child;
+    uint32_t num_children;
+    uint32_t label_offset;
+    uint16_t label_size;
+    uint16_t flags;
+  } Node;
+
+  std::vector<Node> nodes; // the root first
+  std::string labels;
+
+  const Node* child(const Node& node, const char* label, size_t size) const;
+}; // class PublicSuffix
+
+} // namespace urlfactory
+
+#endif // URLFACTORY_PUBLICSUFFIX_H__
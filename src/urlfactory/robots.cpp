@@ -65,8 +65,6 @@ bool Robots::is_allowed(std::string url)
 
 void Robots::initialize(Robots* rbt)
 {
-  bool private_is_good {false};
-
   if (!rbt->host.empty())
   {
     std::string robotstxt;
@@ -74,43 +72,54 @@ void Robots::initialize(Robots* rbt)
 
     rbt->fetch_robots(rbt, robotstxt, http_code);
 
-    if (http_code >= 200 && http_code < 300)
-    {
-      private_is_good = true;
+    setup(rbt, robotstxt, http_code);
+  }
 
-      if (!robotstxt.empty())
-        rbt->parse_file(rbt, robotstxt);
-    }
-    else if (http_code >= 400 && http_code < 500)
-    {
-      // Why ? Because it means the 'robots.txt'
-      // does not exists, so no rules are provided
-      // and it is accepted case.
-      private_is_good = true;
-    }
-    else
-    {
-      private_is_good = false;
-    }
+  rbt->is_tried = true;
+}
 
-#   ifdef MMZ_VERBOZE
-    std::ostringstream oss;
-    if (private_is_good)
-    {
-      oss << "Valid \'robots\' rules: " << rbt->host;
-      print_log(oss.str());
-    }
-    else
-    {
-      oss << "Invalid \'robots\' rules: " << rbt->host;
-      print_warning(oss.str());
-    }
-#   endif
+void Robots::setup(Robots* rbt, std::string& robotstxt, long http_code)
+{
+  bool private_is_good {false};
+
+  if (http_code >= 200 && http_code < 300)
+  {
+    private_is_good = true;
+
+    if (!robotstxt.empty())
+      rbt->parse_file(rbt, robotstxt);
+  }
+  else if (http_code >= 400 && http_code < 500)
+  {
+    // Why ? Because it means the 'robots.txt'
+    // does not exists, so no rules are provided
+    // and it is accepted case.
+    private_is_good = true;
+  }
+  else
+  {
+    private_is_good = false;
+  }
 
-    rbt->is_good = private_is_good;
-    rbt->is_empty = robotstxt.empty();
+# ifdef MMZ_VERBOZE
+  std::ostringstream oss;
+  if (private_is_good)
+  {
+    oss << "Valid \'robots\' rules: " << rbt->host;
+    print_log(oss.str());
   }
+  else
+  {
+    oss << "Invalid \'robots\' rules: " << rbt->host;
+    print_warning(oss.str());
+  }
+# endif
 
+  if (rbt->keep_file)
+    rbt->robotstxt = robotstxt;
+  rbt->http_code = http_code;
+  rbt->is_good = private_is_good;
+  rbt->is_empty = robotstxt.empty();
   rbt->is_tried = true;
 }
 
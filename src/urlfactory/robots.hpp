@@ -52,6 +52,8 @@ public:
     is_tried(false),
     is_good(false),
     is_empty(false),
+    keep_file(false),
+    http_code(-1),
     host(host),
     user_agent(user_agent),
     user_agent_full(user_agent_full),
@@ -87,10 +89,51 @@ public:
     initialize(this);
   }
 
+  /*! Sets the rules from a previously fetched file
+   * \param robotstxt The content of 'robots.txt'
+   * \param http_code The HTTP code it was fetched with
+   */
+  void load(std::string robotstxt, long http_code)
+  {
+    setup(this, robotstxt, http_code);
+  }
+
+  /*! Keeps the raw 'robots.txt' once fetched, until 'take_robotstxt',
+   * otherwise only the rules are kept
+   */
+  void keep_robotstxt()
+  {
+    keep_file = true;
+  }
+
+  /*! Returns the raw 'robots.txt' and forgets it,
+   * useful to save the rules only once
+   */
+  std::string take_robotstxt()
+  {
+    std::string out;
+    out.swap(robotstxt);
+    return out;
+  }
+
+  long get_http_code()
+  {
+    return http_code;
+  }
+
+  std::string get_host()
+  {
+    return host;
+  }
+
 private:
   bool is_tried;
   bool is_good;
   bool is_empty;
+  bool keep_file;
+
+  std::string robotstxt;
+  long http_code;
 
   const std::string host;
   const std::string user_agent;
@@ -102,6 +145,7 @@ private:
   std::vector<UrlParser> doors;
 
   static void initialize(Robots* rbt);
+  static void setup(Robots* rbt, std::string& robotstxt, long http_code);
   static void fetch_robots(Robots* rbt, std::string& robotstxt, long& http_code);
   static void parse_file(Robots* rbt, std::string& robotstxt);
 }; // class Robots
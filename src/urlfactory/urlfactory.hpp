@@ -34,5 +34,6 @@
 #include "network.hpp"
 #include "hexencode.hpp"
 #include "ssanitize.hpp"
+#include "publicsuffix.hpp"
 
 #endif // URLFACTORY_H__
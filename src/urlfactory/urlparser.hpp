@@ -115,6 +115,18 @@ public:
     return host;
   }
 
+  /*! Returns each component of the PATH */
+  const std::vector<std::string>& get_segments()
+  {
+    return segments;
+  }
+
+  /*! Returns each argument of the QUERY */
+  const std::vector<std::string>& get_arguments()
+  {
+    return arguments;
+  }
+
   /*! Returns true if a URL was defined */
   bool empty()
   {
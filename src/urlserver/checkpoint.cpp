@@ -0,0 +1,799 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/checkpoint.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/common.hpp"
+
+namespace mermoz
+{
+
+bool VisitedSet::contains(uint64_t fp)
+{
+  return delta.find(fp) != delta.end()
+         || std::binary_search(base, base + base_size, fp);
+}
+
+bool VisitedSet::insert(uint64_t fp)
+{
+  if (std::binary_search(base, base + base_size, fp))
+    return false;
+
+  return delta.insert(fp).second;
+}
+
+/*
+ * Snapshot header, the visited fingerprints follow as
+ * a sorted array then come frontier, robots and state records
+ */
+typedef struct SnapHeader {
+  uint64_t magic;
+  uint64_t wal_seq; // last log segment folded within
+  uint64_t num_shards;
+  uint64_t num_visited;
+  uint64_t num_frontier;
+  uint64_t num_robots;
+  uint64_t frontier_offset;
+  uint64_t robots_offset;
+  uint64_t num_states;
+  uint64_t states_offset;
+} SnapHeader;
+
+static const uint64_t snap_magic {0x32504e535a4d4d00ULL}; // "MMZSNP2"
+
+static void put_varint(std::string& out, uint64_t value)
+{
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static bool get_varint(const char* data, size_t size, size_t& pos, uint64_t& value)
+{
+  value = 0;
+  for (unsigned int shift = 0; pos < size && shift < 64; shift += 7) {
+    unsigned char c = static_cast<unsigned char>(data[pos++]);
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static bool get_string(const char* data, size_t size, size_t& pos, std::string& out)
+{
+  uint64_t len;
+  if (!get_varint(data, size, pos, len) || pos + len > size)
+    return false;
+  out.assign(data + pos, len);
+  pos += len;
+  return true;
+}
+
+/*
+ * A state record is the string 'kind + key' then the value
+ */
+static void apply_state(const char* data, size_t size, StateMap& states)
+{
+  size_t pos {0};
+  std::string key;
+  if (!get_string(data, size, pos, key))
+    return;
+
+  if (pos == size)
+    states.erase(key);
+  else
+    states[key].assign(data + pos, size - pos);
+}
+
+static uint32_t checksum(char type, const char* data, size_t size)
+{
+  uint64_t hash = fnv1a(&type, 1);
+  hash ^= fnv1a(data, size);
+  return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+/*
+ * Applies the function 'apply(type, payload, size)' on every valid
+ * record of a log segment, stops at the first torn record
+ */
+template<typename Function>
+static void read_wal(const std::string& path, Function apply)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  std::string wal((std::istreambuf_iterator<char>(ifs)),
+                  std::istreambuf_iterator<char>());
+
+  size_t pos {0};
+  while (pos < wal.size()) {
+    char type = wal[pos++];
+
+    uint64_t size;
+    if (!get_varint(wal.data(), wal.size(), pos, size)
+        || pos + size + sizeof(uint32_t) > wal.size())
+      break;
+
+    uint32_t sum;
+    std::memcpy(&sum, wal.data() + pos + size, sizeof(uint32_t));
+    if (sum != checksum(type, wal.data() + pos, size))
+      break;
+
+    apply(type, wal.data() + pos, size);
+    pos += size + sizeof(uint32_t);
+  }
+}
+
+/*
+ * Reads a mapped snapshot, returns false if it is not valid
+ */
+static bool read_snapshot(const char* map,
+                          size_t size,
+                          SnapHeader& header,
+                          std::unordered_map<uint64_t, std::string>& frontier,
+                          std::map<std::string, RobotsEntry>& robots,
+                          StateMap& states)
+{
+  if (size < sizeof(SnapHeader))
+    return false;
+
+  std::memcpy(&header, map, sizeof(SnapHeader));
+  if (header.magic != snap_magic
+      || sizeof(SnapHeader) + header.num_visited*sizeof(uint64_t) > size
+      || header.frontier_offset > size
+      || header.robots_offset > size
+      || header.states_offset > size)
+    return false;
+
+  size_t pos = header.frontier_offset;
+  std::string url;
+  for (uint64_t i = 0; i < header.num_frontier; i++) {
+    if (!get_string(map, header.robots_offset, pos, url))
+      return false;
+    frontier.emplace(fnv1a(url), url);
+  }
+
+  pos = header.robots_offset;
+  std::string host;
+  for (uint64_t i = 0; i < header.num_robots; i++) {
+    RobotsEntry entry;
+    int64_t code;
+    if (!get_string(map, header.states_offset, pos, host)
+        || pos + sizeof(int64_t) > header.states_offset)
+      return false;
+    std::memcpy(&code, map + pos, sizeof(int64_t));
+    pos += sizeof(int64_t);
+    if (!get_string(map, header.states_offset, pos, entry.robotstxt))
+      return false;
+    entry.http_code = static_cast<long>(code);
+    robots[host] = entry;
+  }
+
+  pos = header.states_offset;
+  std::string key;
+  for (uint64_t i = 0; i < header.num_states; i++) {
+    if (!get_string(map, size, pos, key)
+        || !get_string(map, size, pos, states[key]))
+      return false;
+  }
+
+  return true;
+}
+
+Checkpoint::Checkpoint(std::string dir,
+                       unsigned int shard_id,
+                       unsigned int num_shards,
+                       long interval,
+                       MemSec* mem_sec) :
+  dir(dir),
+  shard_id(shard_id),
+  num_shards(num_shards),
+  interval(interval),
+  mem_sec(mem_sec),
+  wal(nullptr),
+  wal_seq(1),
+  last_flush(std::time(nullptr)),
+  last_snapshot(std::time(nullptr)),
+  compacting(false),
+  snap_map(nullptr),
+  snap_size(0)
+{
+  mkdir(dir.c_str(), 0755);
+}
+
+Checkpoint::~Checkpoint()
+{
+  if (compactor.joinable())
+    compactor.join();
+
+  if (wal != nullptr)
+    std::fclose(wal);
+
+  if (snap_map != nullptr)
+    munmap(snap_map, snap_size);
+}
+
+std::string Checkpoint::snap_path()
+{
+  std::ostringstream oss;
+  oss << dir << "/shard-" << shard_id << ".snap";
+  return oss.str();
+}
+
+std::string Checkpoint::wal_path(uint64_t seq)
+{
+  std::ostringstream oss;
+  oss << dir << "/shard-" << shard_id << ".wal." << seq;
+  return oss.str();
+}
+
+/*
+ * Returns the sequence numbers of the log segments of
+ * the shard 'shard_id' found within 'dir', sorted
+ */
+static std::vector<uint64_t> list_wal(const std::string& dir, unsigned int shard_id)
+{
+  std::vector<uint64_t> seqs;
+  std::string prefix {"shard-" + std::to_string(shard_id) + ".wal."};
+
+  DIR* dp = opendir(dir.c_str());
+  if (dp == nullptr)
+    return seqs;
+
+  struct dirent* entry;
+  while ((entry = readdir(dp)) != nullptr) {
+    std::string name {entry->d_name};
+    if (name.compare(0, prefix.size(), prefix) == 0)
+      seqs.push_back(std::strtoull(name.c_str() + prefix.size(), nullptr, 10));
+  }
+  closedir(dp);
+
+  std::sort(seqs.begin(), seqs.end());
+  return seqs;
+}
+
+bool Checkpoint::check(const std::string& dir,
+                       unsigned int num_shards,
+                       std::string& error)
+{
+  DIR* dp = opendir(dir.c_str());
+  if (dp == nullptr)
+    return true;
+
+  // every shard opens its log when it starts, thus has files
+  std::vector<unsigned int> shards;
+  struct dirent* entry;
+  while ((entry = readdir(dp)) != nullptr) {
+    unsigned int id;
+    if (std::sscanf(entry->d_name, "shard-%u.", &id) == 1)
+      shards.push_back(id);
+  }
+  closedir(dp);
+
+  if (shards.empty())
+    return true;
+
+  unsigned int found = *std::max_element(shards.begin(), shards.end()) + 1;
+  if (found != num_shards) {
+    error = dir + " holds " + std::to_string(found) + " shards, not "
+            + std::to_string(num_shards);
+    return false;
+  }
+
+  for (unsigned int id = 0; id < num_shards; id++) {
+    std::string path {dir + "/shard-" + std::to_string(id) + ".snap"};
+    std::ifstream snap(path, std::ios::binary);
+    if (!snap.is_open())
+      continue;
+
+    SnapHeader header;
+    if (!snap.read(reinterpret_cast<char*>(&header), sizeof(SnapHeader))
+        || header.magic != snap_magic
+        || header.num_shards != num_shards) {
+      error = path + " is invalid or of another number of shards";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Checkpoint::clear(const std::string& dir)
+{
+  DIR* dp = opendir(dir.c_str());
+  if (dp == nullptr)
+    return;
+
+  std::vector<std::string> names;
+  struct dirent* entry;
+  while ((entry = readdir(dp)) != nullptr) {
+    unsigned int id;
+    if (std::sscanf(entry->d_name, "shard-%u.", &id) == 1)
+      names.push_back(entry->d_name);
+  }
+  closedir(dp);
+
+  for (auto& name : names)
+    unlink((dir + "/" + name).c_str());
+}
+
+void Checkpoint::open_wal()
+{
+  wal = std::fopen(wal_path(wal_seq).c_str(), "ab");
+  if (wal == nullptr)
+    print_error("Checkpoint: cannot open " + wal_path(wal_seq));
+}
+
+void Checkpoint::reset()
+{
+  for (auto seq : list_wal(dir, shard_id))
+    unlink(wal_path(seq).c_str());
+  unlink(snap_path().c_str());
+
+  wal_seq = 1;
+  open_wal();
+}
+
+bool Checkpoint::restore(VisitedSet& visited,
+                         std::vector<std::string>& frontier,
+                         std::map<std::string, RobotsEntry>& robots,
+                         StateMap& states)
+{
+  std::unordered_map<uint64_t, std::string> pending;
+  SnapHeader header;
+  std::memset(&header, 0, sizeof(SnapHeader));
+
+  int fd = open(snap_path().c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    fstat(fd, &st);
+    snap_size = static_cast<size_t>(st.st_size);
+    snap_map = mmap(nullptr, snap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (snap_map == MAP_FAILED) {
+      snap_map = nullptr;
+      return false;
+    }
+
+    if (!read_snapshot(static_cast<const char*>(snap_map), snap_size,
+                       header, pending, robots, states)
+        || header.num_shards != num_shards) {
+      print_error("Checkpoint: invalid snapshot " + snap_path());
+      return false;
+    }
+
+    // the fingerprints are used in place, never loaded
+    visited.set_base(reinterpret_cast<const uint64_t*>(
+                       static_cast<const char*>(snap_map) + sizeof(SnapHeader)),
+                     header.num_visited);
+  }
+
+  uint64_t last_seq = header.wal_seq;
+
+  for (auto seq : list_wal(dir, shard_id)) {
+    last_seq = std::max(last_seq, seq);
+
+    if (seq <= header.wal_seq)
+      continue;
+
+    read_wal(wal_path(seq), [&](char type, const char* data, size_t size) {
+      uint64_t fp;
+      size_t pos {0};
+      std::string host;
+      RobotsEntry entry;
+
+      switch (type) {
+      case REC_VISITED:
+        std::memcpy(&fp, data, sizeof(uint64_t));
+        visited.insert(fp);
+        pending.erase(fp);
+        break;
+      case REC_FRONTIER:
+        fp = fnv1a(data, size);
+        if (!visited.contains(fp))
+          pending.emplace(fp, std::string(data, size));
+        break;
+      case REC_DROP:
+        std::memcpy(&fp, data, sizeof(uint64_t));
+        pending.erase(fp);
+        break;
+      case REC_ROBOTS:
+        if (get_string(data, size, pos, host)
+            && get_varint(data, size, pos, fp)
+            && get_string(data, size, pos, entry.robotstxt)) {
+          entry.http_code = static_cast<long>(fp) - 1000;
+          robots[host] = entry;
+        }
+        break;
+      case REC_STATE:
+        apply_state(data, size, states);
+        break;
+      }
+    });
+  }
+
+  frontier.clear();
+  frontier.reserve(pending.size());
+  for (auto& url : pending)
+    frontier.push_back(url.second);
+
+  std::ostringstream oss;
+  oss << "Checkpoint: shard " << shard_id << " restored "
+      << visited.size() << " visited, "
+      << frontier.size() << " to visit, "
+      << robots.size() << " robots, "
+      << states.size() << " states";
+  print_strong_log(oss.str());
+
+  /*
+   * New records go to a new segment, the replayed ones
+   * will be folded by the next snapshot
+   */
+  wal_seq = last_seq + 1;
+  open_wal();
+
+  return true;
+}
+
+void Checkpoint::append(char type, const char* data, size_t size)
+{
+  if (wal == nullptr)
+    return;
+
+  std::string record(1, type);
+  put_varint(record, size);
+  record.append(data, size);
+
+  uint32_t sum = checksum(type, data, size);
+  record.append(reinterpret_cast<const char*>(&sum), sizeof(uint32_t));
+
+  std::fwrite(record.data(), 1, record.size(), wal);
+}
+
+void Checkpoint::log_visited(uint64_t fp)
+{
+  append(REC_VISITED, reinterpret_cast<const char*>(&fp), sizeof(uint64_t));
+}
+
+void Checkpoint::log_frontier(const std::string& url)
+{
+  append(REC_FRONTIER, url.data(), url.size());
+}
+
+void Checkpoint::log_drop(uint64_t fp)
+{
+  append(REC_DROP, reinterpret_cast<const char*>(&fp), sizeof(uint64_t));
+}
+
+void Checkpoint::log_robots(const std::string& site, long http_code, const std::string& robotstxt)
+{
+  std::string payload;
+  put_varint(payload, site.size());
+  payload.append(site);
+  // libcurl error codes are negative or small, shifted to stay unsigned
+  put_varint(payload, static_cast<uint64_t>(http_code + 1000));
+  put_varint(payload, robotstxt.size());
+  payload.append(robotstxt);
+
+  append(REC_ROBOTS, payload.data(), payload.size());
+}
+
+void Checkpoint::log_state(char kind, const std::string& key, const std::string& value)
+{
+  std::string payload;
+  put_varint(payload, key.size() + 1);
+  payload.push_back(kind);
+  payload.append(key);
+  payload.append(value);
+
+  append(REC_STATE, payload.data(), payload.size());
+}
+
+void Checkpoint::tick()
+{
+  std::time_t now = std::time(nullptr);
+
+  if (wal == nullptr || now == last_flush)
+    return;
+
+  /*
+   * Group commit, at most one second of work is lost
+   */
+  std::fflush(wal);
+  last_flush = now;
+
+  if (now - last_snapshot < interval || compacting)
+    return;
+
+  fsync(fileno(wal));
+  std::fclose(wal);
+
+  uint64_t closed_seq = wal_seq++;
+  open_wal();
+
+  if (compactor.joinable())
+    compactor.join();
+
+  compacting = true;
+  compactor = std::thread(compact, this, closed_seq);
+  last_snapshot = now;
+}
+
+/*
+ * Memory held by what the compactor loads, with a rough
+ * cost for the nodes of the containers
+ */
+static size_t loaded_memory(const std::unordered_map<uint64_t, std::string>& frontier,
+                            const std::map<std::string, RobotsEntry>& robots,
+                            const StateMap& states,
+                            size_t num_visited)
+{
+  size_t mem {num_visited*sizeof(uint64_t)};
+
+  for (auto& url : frontier)
+    mem += url.second.size() + 64;
+  for (auto& entry : robots)
+    mem += entry.first.size() + entry.second.robotstxt.size() + 96;
+  for (auto& state : states)
+    mem += state.first.size() + state.second.size() + 64;
+
+  return mem;
+}
+
+void Checkpoint::compact(Checkpoint* ckpt, uint64_t last_seq)
+{
+  SnapHeader header;
+  std::memset(&header, 0, sizeof(SnapHeader));
+
+  std::unordered_map<uint64_t, std::string> frontier;
+  std::map<std::string, RobotsEntry> robots;
+  StateMap states;
+
+  const uint64_t* old_visited {nullptr};
+  void* map {nullptr};
+  size_t map_size {0};
+
+  int fd = open(ckpt->snap_path().c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    fstat(fd, &st);
+    map_size = static_cast<size_t>(st.st_size);
+    map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED
+        || !read_snapshot(static_cast<const char*>(map), map_size,
+                          header, frontier, robots, states)) {
+      print_error("Checkpoint: invalid snapshot " + ckpt->snap_path());
+      if (map != MAP_FAILED)
+        munmap(map, map_size);
+      ckpt->compacting = false;
+      return;
+    }
+
+    old_visited = reinterpret_cast<const uint64_t*>(
+                    static_cast<const char*>(map) + sizeof(SnapHeader));
+  }
+
+  const uint64_t old_seq = header.wal_seq;
+  std::vector<uint64_t> folded;
+  std::vector<uint64_t> new_visited;
+
+  // charged as the segments are read, released once written
+  size_t charged {0};
+  auto charge = [&]() {
+    size_t mem = loaded_memory(frontier, robots, states, new_visited.size());
+    if (mem > charged) {
+      (*ckpt->mem_sec) += mem - charged;
+      charged = mem;
+    }
+  };
+  charge();
+
+  for (auto seq : list_wal(ckpt->dir, ckpt->shard_id)) {
+    if (seq <= old_seq || seq > last_seq)
+      continue;
+
+    folded.push_back(seq);
+
+    read_wal(ckpt->wal_path(seq), [&](char type, const char* data, size_t size) {
+      uint64_t fp;
+      size_t pos {0};
+      std::string host;
+      RobotsEntry entry;
+
+      switch (type) {
+      case REC_VISITED:
+        std::memcpy(&fp, data, sizeof(uint64_t));
+        new_visited.push_back(fp);
+        frontier.erase(fp);
+        break;
+      case REC_FRONTIER:
+        frontier.emplace(fnv1a(data, size), std::string(data, size));
+        break;
+      case REC_DROP:
+        std::memcpy(&fp, data, sizeof(uint64_t));
+        frontier.erase(fp);
+        break;
+      case REC_ROBOTS:
+        if (get_string(data, size, pos, host)
+            && get_varint(data, size, pos, fp)
+            && get_string(data, size, pos, entry.robotstxt)) {
+          entry.http_code = static_cast<long>(fp) - 1000;
+          robots[host] = entry;
+        }
+        break;
+      case REC_STATE:
+        apply_state(data, size, states);
+        break;
+      }
+    });
+
+    charge();
+  }
+
+  std::sort(new_visited.begin(), new_visited.end());
+  new_visited.erase(std::unique(new_visited.begin(), new_visited.end()),
+                    new_visited.end());
+
+  /*
+   * The new snapshot is written aside, the merge of the
+   * visited fingerprints is streamed to avoid a copy
+   */
+  std::string tmp_path {ckpt->snap_path() + ".tmp"};
+  FILE* fp = std::fopen(tmp_path.c_str(), "wb");
+  if (fp == nullptr) {
+    print_error("Checkpoint: cannot write " + tmp_path);
+    if (map != nullptr)
+      munmap(map, map_size);
+    (*ckpt->mem_sec) -= charged;
+    ckpt->compacting = false;
+    return;
+  }
+
+  SnapHeader new_header;
+  std::memset(&new_header, 0, sizeof(SnapHeader));
+  std::fwrite(&new_header, sizeof(SnapHeader), 1, fp);
+
+  const uint64_t* old_it = old_visited;
+  const uint64_t* old_end = old_visited + header.num_visited;
+  auto new_it = new_visited.begin();
+
+  while (old_it != old_end || new_it != new_visited.end()) {
+    uint64_t value;
+    if (new_it == new_visited.end()
+        || (old_it != old_end && *old_it <= *new_it)) {
+      value = *old_it++;
+      if (new_it != new_visited.end() && *new_it == value)
+        new_it++;
+    } else {
+      value = *new_it++;
+    }
+    std::fwrite(&value, sizeof(uint64_t), 1, fp);
+    new_header.num_visited++;
+  }
+
+  new_header.frontier_offset = sizeof(SnapHeader)
+                               + new_header.num_visited*sizeof(uint64_t);
+
+  std::string record;
+  for (auto& url : frontier) {
+    if (std::binary_search(new_visited.begin(), new_visited.end(), url.first)
+        || std::binary_search(old_visited, old_end, url.first))
+      continue;
+
+    record.clear();
+    put_varint(record, url.second.size());
+    record.append(url.second);
+    std::fwrite(record.data(), 1, record.size(), fp);
+
+    new_header.num_frontier++;
+    new_header.robots_offset += record.size();
+  }
+
+  new_header.robots_offset += new_header.frontier_offset;
+
+  for (auto& entry : robots) {
+    int64_t code = entry.second.http_code;
+
+    record.clear();
+    put_varint(record, entry.first.size());
+    record.append(entry.first);
+    record.append(reinterpret_cast<const char*>(&code), sizeof(int64_t));
+    put_varint(record, entry.second.robotstxt.size());
+    record.append(entry.second.robotstxt);
+    std::fwrite(record.data(), 1, record.size(), fp);
+
+    new_header.num_robots++;
+    new_header.states_offset += record.size();
+  }
+
+  new_header.states_offset += new_header.robots_offset;
+
+  for (auto& state : states) {
+    record.clear();
+    put_varint(record, state.first.size());
+    record.append(state.first);
+    put_varint(record, state.second.size());
+    record.append(state.second);
+    std::fwrite(record.data(), 1, record.size(), fp);
+
+    new_header.num_states++;
+  }
+
+  if (map != nullptr)
+    munmap(map, map_size);
+
+  frontier.clear();
+  robots.clear();
+  states.clear();
+  new_visited.clear();
+  new_visited.shrink_to_fit();
+  (*ckpt->mem_sec) -= charged;
+
+  new_header.magic = snap_magic;
+  new_header.wal_seq = std::max(old_seq, last_seq);
+  new_header.num_shards = ckpt->num_shards;
+
+  std::fseek(fp, 0, SEEK_SET);
+  std::fwrite(&new_header, sizeof(SnapHeader), 1, fp);
+  std::fflush(fp);
+  fsync(fileno(fp));
+  std::fclose(fp);
+
+  if (std::rename(tmp_path.c_str(), ckpt->snap_path().c_str()) == 0) {
+    for (auto seq : folded)
+      unlink(ckpt->wal_path(seq).c_str());
+
+#   ifdef MMZ_VERBOSE
+    std::ostringstream oss;
+    oss << "Checkpoint: shard " << ckpt->shard_id << " snapshot with "
+        << new_header.num_visited << " visited and "
+        << new_header.num_frontier << " to visit";
+    print_log(oss.str());
+#   endif
+  }
+
+  ckpt->compacting = false;
+}
+
+} // namespace mermoz
@@ -0,0 +1,183 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_CHECKPOINT_H__
+#define MERMOZ_CHECKPOINT_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <ctime>
+
+#include "common/memsec.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Set of visited URL fingerprints
+ *
+ * The 'base' is a sorted array, mapped from the last snapshot
+ * when the crawl is resumed, and never copied in memory.
+ * Fingerprints found since are saved within the 'delta' set.
+ */
+class VisitedSet
+{
+public:
+  VisitedSet() : base(nullptr), base_size(0) {}
+
+  void set_base(const uint64_t* base, size_t base_size)
+  {
+    this->base = base;
+    this->base_size = base_size;
+  }
+
+  bool contains(uint64_t fp);
+
+  /*! Returns true if 'fp' was not yet within the set */
+  bool insert(uint64_t fp);
+
+  size_t size()
+  {
+    return base_size + delta.size();
+  }
+
+private:
+  const uint64_t* base;
+  size_t base_size;
+  std::unordered_set<uint64_t> delta;
+}; // class VisitedSet
+
+typedef struct RobotsEntry {
+  long http_code;
+  std::string robotstxt;
+} RobotsEntry;
+
+/*
+ * Latest value of the keyed states saved by the urlserver
+ * components, a key starts with the kind of its state
+ */
+typedef std::unordered_map<std::string, std::string> StateMap;
+
+/*! \brief Crash consistent state of one urlserver shard
+ *
+ * Every change is appended to a write-ahead log, records carry a
+ * checksum so a torn tail is ignored. Each 'interval' seconds the log
+ * is rotated and a background thread folds the closed segments into
+ * a new snapshot written aside then renamed, the shard never stops.
+ *
+ * Files within 'dir': 'shard-N.snap' and 'shard-N.wal.SEQ'.
+ */
+class Checkpoint
+{
+public:
+  Checkpoint(std::string dir,
+             unsigned int shard_id,
+             unsigned int num_shards,
+             long interval,
+             MemSec* mem_sec);
+  ~Checkpoint();
+
+  /*! Returns false, with the reason within 'error', if the files of
+   * 'dir' were not written by a crawl of 'num_shards' shards
+   */
+  static bool check(const std::string& dir,
+                    unsigned int num_shards,
+                    std::string& error);
+
+  /*! Removes the files of every shard of a previous crawl */
+  static void clear(const std::string& dir);
+
+  /*! Removes the files of a previous crawl and opens a new log */
+  void reset();
+
+  /*! Maps the last snapshot and replays the logs written since
+   * \param visited Receives the snapshot as base and the logs as delta
+   * \param frontier URLs found but not yet visited
+   * \param robots Saved 'robots.txt' per site (SCHEME://AUTHORITY)
+   * \param states Last value of each key given to 'log_state'
+   */
+  bool restore(VisitedSet& visited,
+               std::vector<std::string>& frontier,
+               std::map<std::string, RobotsEntry>& robots,
+               StateMap& states);
+
+  void log_visited(uint64_t fp);
+  void log_frontier(const std::string& url);
+  void log_drop(uint64_t fp);
+  void log_robots(const std::string& site, long http_code, const std::string& robotstxt);
+
+  /*! Saves the state 'key' of kind 'kind', an empty 'value' erases it */
+  void log_state(char kind, const std::string& key, const std::string& value);
+
+  /*! To call often, flushes the log and triggers the snapshots */
+  void tick();
+
+  enum {
+    REC_VISITED = 'V',
+    REC_FRONTIER = 'F',
+    REC_DROP = 'D',
+    REC_ROBOTS = 'R',
+    REC_STATE = 'S'
+  };
+
+private:
+  const std::string dir;
+  const unsigned int shard_id;
+  const unsigned int num_shards;
+  const long interval;
+
+  MemSec* mem_sec; // charged with what the compactor loads
+
+  FILE* wal;
+  uint64_t wal_seq;
+  std::time_t last_flush;
+  std::time_t last_snapshot;
+
+  std::thread compactor;
+  std::atomic<bool> compacting;
+
+  // mapping of the snapshot the crawl was resumed from
+  void* snap_map;
+  size_t snap_size;
+
+  std::string snap_path();
+  std::string wal_path(uint64_t seq);
+  void open_wal();
+  void append(char type, const char* data, size_t size);
+
+  static void compact(Checkpoint* ckpt, uint64_t last_seq);
+}; // class Checkpoint
+
+} // namespace mermoz
+
+#endif // MERMOZ_CHECKPOINT_H__
@@ -0,0 +1,213 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/dust.hpp"
+
+#include <cstring>
+
+#include "common/hashing.hpp"
+
+namespace mermoz
+{
+
+/*
+ * Offsets and sizes of the non empty arguments of 'url', 'query'
+ * is the position of its '?' and 'end' the one of its '#' or its size
+ */
+static void split_query(const char* url,
+                        size_t size,
+                        size_t& query,
+                        size_t& end,
+                        std::vector<std::pair<size_t, size_t>>& args)
+{
+  args.clear();
+
+  const char* q = static_cast<const char*>(std::memchr(url, '?', size));
+  query = q == nullptr ? size : q - url;
+
+  const char* f = static_cast<const char*>(std::memchr(url + query, '#', size - query));
+  end = f == nullptr ? size : f - url;
+
+  size_t beg = query + 1;
+  for (size_t i = beg; i <= end && beg < end; i++)
+    if (i == end || url[i] == '&' || url[i] == ';') {
+      if (i > beg)
+        args.emplace_back(beg, i - beg);
+      beg = i + 1;
+    }
+}
+
+static std::string arg_name(const char* arg, size_t size)
+{
+  const char* eq = static_cast<const char*>(std::memchr(arg, '=', size));
+  return std::string(arg, eq == nullptr ? size : eq - arg);
+}
+
+DustRules::DustRules(unsigned int min_same) :
+  min_same(min_same),
+  num_rules(0)
+{
+}
+
+DustRules::Rule& DustRules::rule(uint64_t host_id,
+                                 const std::string& host,
+                                 const std::string& name)
+{
+  HostRules& host_rules = hosts[host_id];
+  if (host_rules.host.empty())
+    host_rules.host = host;
+
+  for (auto& rule : host_rules.rules)
+    if (rule.name == name)
+      return rule;
+
+  num_rules++;
+  host_rules.rules.push_back({name, 0, 0, 0, false});
+  return host_rules.rules.back();
+}
+
+void DustRules::observe(const std::string& url, const std::string& host, uint64_t digest)
+{
+  size_t query;
+  size_t end;
+  std::vector<std::pair<size_t, size_t>> args;
+  split_query(url.data(), url.size(), query, end, args);
+
+  if (args.empty() || args.size() > max_arguments)
+    return;
+
+  if (samples.size() >= max_samples)
+    samples.clear();
+
+  const uint64_t host_id = fnv1a(host);
+  std::string key;
+
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string name = arg_name(url.data() + args[i].first, args[i].second);
+
+    // the URL without this argument, then its name
+    key.assign(url, 0, query);
+    char sep {'?'};
+    for (size_t j = 0; j < args.size(); j++)
+      if (j != i) {
+        key.push_back(sep);
+        key.append(url, args[j].first, args[j].second);
+        sep = '&';
+      }
+    key.push_back('\n');
+    key.append(name);
+
+    const uint64_t value = fnv1a(url.data() + args[i].first, args[i].second);
+
+    auto res = samples.emplace(fnv1a(key), Sample {digest, value});
+    if (res.second || res.first->second.value == value)
+      continue;
+
+    Rule& r = rule(host_id, host, name);
+    if (res.first->second.digest == digest)
+      r.same++;
+    else
+      r.differ++;
+    r.changed = true;
+
+    res.first->second = {digest, value};
+  }
+}
+
+bool DustRules::strip(const char* url, size_t size, uint64_t host_id, std::string& out)
+{
+  auto it = hosts.find(host_id);
+  if (it == hosts.end())
+    return false;
+
+  size_t query;
+  size_t end;
+  std::vector<std::pair<size_t, size_t>> args;
+  split_query(url, size, query, end, args);
+
+  if (args.empty())
+    return false;
+
+  out.assign(url, query);
+
+  bool stripped {false};
+  char sep {'?'};
+  for (auto& arg : args) {
+    const std::string name = arg_name(url + arg.first, arg.second);
+
+    bool drop {false};
+    for (auto& rule : it->second.rules)
+      if (rule.name == name && active(rule)) {
+        rule.hits++;
+        rule.changed = true;
+        drop = true;
+        break;
+      }
+
+    if (drop) {
+      stripped = true;
+    } else {
+      out.push_back(sep);
+      out.append(url + arg.first, arg.second);
+      sep = '&';
+    }
+  }
+
+  out.append(url + end, size - end);
+  return stripped;
+}
+
+void DustRules::load(const std::string& key, const std::string& state)
+{
+  size_t space = key.find(' ');
+  if (space == std::string::npos || state.size() < sizeof(SavedRule))
+    return;
+
+  SavedRule saved;
+  std::memcpy(&saved, state.data(), sizeof(SavedRule));
+
+  std::string host {key.substr(0, space)};
+  Rule& r = rule(fnv1a(host), host, key.substr(space + 1));
+  r.same = saved.same;
+  r.differ = saved.differ;
+  r.hits = saved.hits;
+}
+
+void DustRules::report(std::ostream& os) const
+{
+  for (auto& host : hosts)
+    for (auto& rule : host.second.rules)
+      if (active(rule))
+        os << host.second.host << " "
+           << rule.name << " "
+           << rule.same << " "
+           << rule.differ << " "
+           << rule.hits << std::endl;
+}
+
+} // namespace mermoz
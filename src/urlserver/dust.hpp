@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_DUST_H__
+#define MERMOZ_DUST_H__
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+
+namespace mermoz
+{
+
+/*! \brief Query arguments learned per host as not changing the page
+ *
+ * Duplicate URLs with different text (DUST): tracking arguments or
+ * session identifiers give many URLs to a same page. Each fetched page
+ * is seen from each of its arguments, keyed by the URL without it: two
+ * pages of a same key whose argument differs compare their digests. An
+ * argument which gave the same page at least 'min_same' times, and a
+ * different one less than once every ten times, becomes a rule and is
+ * stripped from the links of its host before they are deduplicated.
+ */
+class DustRules
+{
+public:
+  DustRules(unsigned int min_same);
+
+  /*! A page of 'host' was fetched, learns from its arguments */
+  void observe(const std::string& url, const std::string& host, uint64_t digest);
+
+  /*! Writes into 'out' the URL without the arguments of the
+   * rules of its host, returns false if nothing was stripped
+   */
+  bool strip(const char* url, size_t size, uint64_t host_id, std::string& out);
+
+  /*! Calls 'f(key, state)' for each rule changed since the last call */
+  template<typename F>
+  void save_changed(F f);
+
+  /*! Restores a rule saved with 'save_changed' */
+  void load(const std::string& key, const std::string& state);
+
+  /*! One line per rule: 'host argument same differ hits' */
+  void report(std::ostream& os) const;
+
+  /*! Approximate memory used by the samples and the rules */
+  size_t memory() const
+  {
+    return samples.size()*sample_mem + num_rules*rule_mem;
+  }
+
+  static const char state_kind {'U'};
+
+private:
+  typedef struct Sample {
+    uint64_t digest; // of the page
+    uint64_t value; // hash of the argument
+  } Sample;
+
+  typedef struct Rule {
+    std::string name;
+    uint32_t same;
+    uint32_t differ;
+    uint64_t hits;
+    bool changed;
+  } Rule;
+
+  typedef struct SavedRule {
+    uint32_t same;
+    uint32_t differ;
+    uint64_t hits;
+  } SavedRule;
+
+  typedef struct HostRules {
+    std::string host;
+    std::vector<Rule> rules;
+  } HostRules;
+
+  bool active(const Rule& rule) const
+  {
+    return rule.same >= min_same && rule.differ*10 < rule.same;
+  }
+
+  Rule& rule(uint64_t host_id, const std::string& host, const std::string& name);
+
+  static const size_t max_arguments {8};
+  static const size_t sample_mem {32};
+  static const size_t rule_mem {64};
+  // a samples map larger than that is reset, the rules stay
+  static const size_t max_samples {1UL << 21};
+
+  unsigned int min_same;
+  size_t num_rules;
+
+  std::unordered_map<uint64_t, Sample> samples;
+  std::unordered_map<uint64_t, HostRules> hosts;
+}; // class DustRules
+
+template<typename F>
+void DustRules::save_changed(F f)
+{
+  for (auto& host : hosts)
+    for (auto& rule : host.second.rules) {
+      if (!rule.changed)
+        continue;
+
+      SavedRule saved {rule.same, rule.differ, rule.hits};
+      f(host.second.host + " " + rule.name,
+        std::string(reinterpret_cast<const char*>(&saved), sizeof(SavedRule)));
+      rule.changed = false;
+    }
+}
+
+} // namespace mermoz
+
+#endif // MERMOZ_DUST_H__
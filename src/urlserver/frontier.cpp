@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/frontier.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace mermoz
+{
+
+float DepthScorer::score(const FrontierEntry& entry)
+{
+  return 1.0f/(1.0f + entry.meta.depth);
+}
+
+float OpicScorer::score(const FrontierEntry& entry)
+{
+  /*
+   * Cash is split among the links of a page,
+   * a log scale keeps distinct values from 1 to 1e-6
+   */
+  if (entry.meta.cash <= 0.0f)
+    return 0.0f;
+
+  float s = (std::log10(entry.meta.cash) + 6.0f)/6.0f;
+  return std::min(1.0f, std::max(0.0f, s));
+}
+
+float SeedScorer::score(const FrontierEntry& entry)
+{
+  return 1.0f/(1.0f + entry.meta.host_hops);
+}
+
+float HostScorer::score(const FrontierEntry& entry)
+{
+  auto it = host_counts->find(entry.host);
+  unsigned int count = it == host_counts->end() ? 0 : it->second;
+
+  return 1.0f/(1.0f + std::sqrt(static_cast<float>(count)));
+}
+
+Frontier::Frontier(const FrontierWeights& weights) :
+  total_weight(0.0f),
+  filled(0)
+{
+  add_scorer(new DepthScorer(), weights.depth);
+  add_scorer(new OpicScorer(), weights.opic);
+  add_scorer(new SeedScorer(), weights.seed);
+  add_scorer(new HostScorer(&host_counts), weights.host);
+}
+
+void Frontier::add_scorer(Scorer* scorer, float weight)
+{
+  std::unique_ptr<Scorer> ptr(scorer);
+
+  if (weight <= 0.0f)
+    return;
+
+  scorers.emplace_back(std::move(ptr), weight);
+  total_weight += weight;
+}
+
+unsigned int Frontier::bucket(const FrontierEntry& entry)
+{
+  if (total_weight <= 0.0f)
+    return 0;
+
+  float sum {0.0f};
+  for (auto& scorer : scorers)
+    sum += scorer.second * scorer.first->score(entry);
+
+  unsigned int b = static_cast<unsigned int>(sum/total_weight*num_buckets);
+  return std::min(b, num_buckets - 1);
+}
+
+bool Frontier::push(FrontierEntry& entry, uint64_t fp)
+{
+  if (merge(fp, entry.meta))
+    return false;
+
+  unsigned int b = bucket(entry);
+
+  host_counts[entry.host]++;
+  entries.emplace(fp, Slot {std::move(entry), b});
+
+  buckets[b].push_back(fp);
+  filled |= 1ULL << b;
+
+  return true;
+}
+
+bool Frontier::merge(uint64_t fp, const CrawlMeta& meta)
+{
+  auto it = entries.find(fp);
+  if (it == entries.end())
+    return false;
+
+  CrawlMeta& cur = it->second.entry.meta;
+  cur.cash += meta.cash;
+  cur.depth = std::min(cur.depth, meta.depth);
+  cur.host_hops = std::min(cur.host_hops, meta.host_hops);
+
+  unsigned int b = bucket(it->second.entry);
+  if (b > it->second.bucket) {
+    // the old position becomes stale
+    it->second.bucket = b;
+    buckets[b].push_back(fp);
+    filled |= 1ULL << b;
+  }
+
+  return true;
+}
+
+bool Frontier::pop(FrontierEntry& entry)
+{
+  while (filled != 0) {
+    unsigned int b = 63 - __builtin_clzll(filled);
+
+    uint64_t fp = buckets[b].front();
+    buckets[b].pop_front();
+
+    if (buckets[b].empty())
+      filled &= ~(1ULL << b);
+
+    auto it = entries.find(fp);
+    if (it == entries.end() || it->second.bucket != b)
+      continue; // stale position
+
+    entry = std::move(it->second.entry);
+    entries.erase(it);
+
+    auto hit = host_counts.find(entry.host);
+    if (--hit->second == 0)
+      host_counts.erase(hit);
+
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace mermoz
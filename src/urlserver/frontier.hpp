@@ -0,0 +1,159 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_FRONTIER_H__
+#define MERMOZ_FRONTIER_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "common/common.hpp"
+
+namespace mermoz
+{
+
+typedef struct FrontierEntry {
+  std::string url;
+  std::string host;
+  CrawlMeta meta;
+} FrontierEntry;
+
+/*! \brief Gives the value of an URL to crawl
+ *
+ * Scores are within [0, 1], the higher the sooner the URL is fetched
+ */
+class Scorer
+{
+public:
+  virtual ~Scorer() {}
+  virtual float score(const FrontierEntry& entry) = 0;
+};
+
+/*! Breadth first, the closer from a seed the better */
+class DepthScorer : public Scorer
+{
+public:
+  float score(const FrontierEntry& entry);
+};
+
+/*! OPIC, pages linked by many important pages got more cash */
+class OpicScorer : public Scorer
+{
+public:
+  float score(const FrontierEntry& entry);
+};
+
+/*! Seed proximity, favours hosts few host changes away from a seed */
+class SeedScorer : public Scorer
+{
+public:
+  float score(const FrontierEntry& entry);
+};
+
+/*! Host diversity, the more URLs of a host wait the lower its new ones */
+class HostScorer : public Scorer
+{
+public:
+  HostScorer(std::unordered_map<std::string, unsigned int>* host_counts) :
+    host_counts(host_counts) {}
+
+  float score(const FrontierEntry& entry);
+
+private:
+  std::unordered_map<std::string, unsigned int>* host_counts;
+};
+
+typedef struct FrontierWeights {
+  float depth;
+  float opic;
+  float seed;
+  float host;
+} FrontierWeights;
+
+/*! \brief Bucketed priority queue of the URLs to crawl
+ *
+ * The weighted sum of the scorers picks one of 'num_buckets' FIFO,
+ * a bit mask tracks the non empty ones so 'push' and 'pop' are O(1).
+ * Finding again an URL adds its cash and may move it to a higher
+ * bucket, the old position is skipped when popped.
+ */
+class Frontier
+{
+public:
+  Frontier(const FrontierWeights& weights);
+
+  /*! Returns false if the URL was already within, its meta is then merged */
+  bool push(FrontierEntry& entry, uint64_t fp);
+
+  /*! Merges the meta of a link found again, returns false if unknown */
+  bool merge(uint64_t fp, const CrawlMeta& meta);
+
+  bool pop(FrontierEntry& entry);
+
+  bool contains(uint64_t fp)
+  {
+    return entries.find(fp) != entries.end();
+  }
+
+  size_t size()
+  {
+    return entries.size();
+  }
+
+  bool empty()
+  {
+    return entries.empty();
+  }
+
+  static const unsigned int num_buckets {64};
+
+private:
+  typedef struct Slot {
+    FrontierEntry entry;
+    unsigned int bucket;
+  } Slot;
+
+  std::vector<std::pair<std::unique_ptr<Scorer>, float>> scorers;
+  float total_weight;
+
+  std::deque<uint64_t> buckets[num_buckets];
+  uint64_t filled; // bit i is set if buckets[i] is not empty
+
+  std::unordered_map<uint64_t, Slot> entries;
+  std::unordered_map<std::string, unsigned int> host_counts;
+
+  void add_scorer(Scorer* scorer, float weight);
+  unsigned int bucket(const FrontierEntry& entry);
+}; // class Frontier
+
+} // namespace mermoz
+
+#endif // MERMOZ_FRONTIER_H__
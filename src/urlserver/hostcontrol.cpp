@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/hostcontrol.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include <curl/curl.h>
+
+namespace mermoz
+{
+
+constexpr float HostControl::initial_window;
+constexpr float HostControl::max_window;
+
+HostControl::HostControl() :
+  in_flight(0),
+  idle_since(0),
+  resolving(false),
+  resolved(false),
+  waiting_block(false),
+  window(initial_window),
+  latency(-1.0f),
+  baseline(-1.0f),
+  last_cut(0),
+  num_ok(0),
+  num_throttled(0),
+  num_timeouts(0),
+  reason("start")
+{
+}
+
+void HostControl::done(long http_code, long latency_ms, std::time_t now)
+{
+  if (in_flight > 0)
+    in_flight--;
+
+  bool timeout = (http_code == CURLE_OPERATION_TIMEDOUT);
+  bool throttled = (http_code == 429 || http_code == 503);
+
+  if (timeout || throttled) {
+    if (timeout)
+      num_timeouts++;
+    else
+      num_throttled++;
+
+    // one cut per burst of failures
+    if (now != last_cut) {
+      window = std::max(1.0f, window/2.0f);
+      last_cut = now;
+      reason = timeout ? "timeout" : (http_code == 429 ? "429" : "503");
+    }
+    return;
+  }
+
+  if (http_code < 100 || latency_ms < 0)
+    return; // connection errors say nothing of the load
+
+  num_ok++;
+
+  float sample = static_cast<float>(latency_ms);
+  if (latency < 0.0f) {
+    latency = sample;
+    baseline = sample;
+  } else {
+    latency += 0.2f*(sample - latency);
+    // the baseline follows a slower host, but slowly
+    baseline = sample < baseline ? sample : baseline + 0.01f*(sample - baseline);
+  }
+
+  /*
+   * A time to first byte growing with the number of fetches
+   * in flight is the sign of a host near its capacity
+   */
+  const float floor_ms {50.0f}; // network jitter of fast hosts
+  float slack = std::max(baseline, floor_ms);
+
+  if (latency > baseline + 3.0f*slack) {
+    window = std::max(1.0f, window - 1.0f/window);
+    reason = "latency";
+  } else if (latency < baseline + slack && in_flight + 1 >= limit()) {
+    // grows only if the window is used
+    float grown = std::min(max_window, window + 1.0f/window);
+    if (static_cast<unsigned int>(grown) != limit())
+      reason = "stable";
+    window = grown;
+  }
+}
+
+bool HostControl::quiet() const
+{
+  return deferred.empty() && window >= initial_window;
+}
+
+void HostControl::report(const std::string& host, std::ostream& os) const
+{
+  os << host << " "
+     << (block.empty() ? "-" : block) << " "
+     << limit() << " "
+     << in_flight << " "
+     << deferred.size() << " "
+     << static_cast<long>(latency) << " "
+     << static_cast<long>(baseline) << " "
+     << num_ok << " "
+     << num_throttled << " "
+     << num_timeouts << " "
+     << reason << std::endl;
+}
+
+void HostReport::write(std::ostream& os, const std::string& prefix)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (unsigned int s_id = 0; s_id < reports.size(); s_id++) {
+    std::istringstream iss(reports[s_id]);
+    std::string line;
+    while (std::getline(iss, line))
+      os << prefix << " " << s_id << " " << line << std::endl;
+  }
+}
+
+} // namespace mermoz
@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_HOSTCONTROL_H__
+#define MERMOZ_HOSTCONTROL_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <ctime>
+#include <memory>
+
+#include "common/messages.hpp"
+
+namespace mermoz
+{
+
+/*! \brief Number of fetches of a host allowed in flight (AIMD)
+ *
+ * The window grows by one every 'window' successes while the time to
+ * the first byte stays close to the fastest seen on the host, and is
+ * halved, at most once per second, on timeouts, 429 and 503 answers.
+ */
+class HostControl
+{
+public:
+  HostControl();
+
+  bool can_send() const
+  {
+    return in_flight < limit();
+  }
+
+  unsigned int limit() const
+  {
+    return static_cast<unsigned int>(window);
+  }
+
+  /*! A fetch is over, 'latency' in ms or negative if unknown */
+  void done(long http_code, long latency, std::time_t now);
+
+  /*! Returns true if the host is not worth to be reported */
+  bool quiet() const;
+
+  /*! One line: 'host block window in_flight deferred latency baseline ok throttled timeouts reason' */
+  void report(const std::string& host, std::ostream& os) const;
+
+  unsigned int in_flight;
+  std::deque<std::unique_ptr<FetchTask>> deferred; // over the limit, in order
+  std::time_t idle_since; // 0 if in use
+
+  /*
+   * Address of the host and its /24 or /48 block,
+   * which has its own budget of fetches in flight
+   */
+  std::string ip;
+  std::string block;
+  bool resolving;
+  bool resolved;
+  bool waiting_block; // queued until its block has a free slot
+
+  static constexpr float initial_window {4.0f};
+  static constexpr float max_window {64.0f};
+
+private:
+  float window;
+  float latency; // moving average of the time to first byte, ms
+  float baseline; // lowest time to first byte, slowly forgotten, ms
+  std::time_t last_cut;
+
+  uint32_t num_ok;
+  uint32_t num_throttled; // 429 and 503
+  uint32_t num_timeouts;
+  const char* reason; // of the last change of the window
+};
+
+/*! \brief Controls of the throttled hosts per shard, for 'hosts.out' */
+class HostReport
+{
+public:
+  HostReport(unsigned int num_shards) : reports(num_shards) {}
+
+  void set(unsigned int shard_id, std::string report)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reports[shard_id].swap(report);
+  }
+
+  /*! Writes the reports of the shards, each line starts with 'prefix' */
+  void write(std::ostream& os, const std::string& prefix);
+
+private:
+  std::mutex mutex;
+  std::vector<std::string> reports;
+};
+
+} // namespace mermoz
+
+#endif // MERMOZ_HOSTCONTROL_H__
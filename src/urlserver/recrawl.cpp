@@ -0,0 +1,336 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/recrawl.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "common/common.hpp"
+
+namespace mermoz
+{
+
+uint64_t RecrawlStats::num_tracked()
+{
+  uint64_t sum {0};
+  for (auto& t : tracked)
+    sum += t;
+  return sum;
+}
+
+float RecrawlStats::freshness()
+{
+  uint64_t sum_tracked {num_tracked()};
+  if (sum_tracked == 0)
+    return 1.0f;
+
+  uint64_t sum_fresh {0};
+  for (auto& f : fresh)
+    sum_fresh += f;
+
+  return static_cast<float>(sum_fresh)/sum_tracked;
+}
+
+/*
+ * Pages known from few checks rely on the rate of their host, as
+ * if the host rate had been seen over 'prior_checks' more checks
+ */
+static const double prior_checks {4.0};
+
+Recrawl::Recrawl(const RecrawlSettings& settings, std::time_t now) :
+  settings(settings),
+  wheel(wheel_size),
+  wheel_time(now),
+  cursor(0)
+{
+}
+
+/*
+ * Estimator of a Poisson rate from 'checks' regular visits among which
+ * 'changes' found a new content (Cho & Garcia-Molina), unlike the naive
+ * 'changes/elapsed' it accounts for the changes missed between visits.
+ * Returns -1 if nothing is known.
+ */
+double Recrawl::estimate(const Change& change)
+{
+  if (change.checks == 0 || change.elapsed <= 0.0)
+    return -1.0;
+
+  double n = change.checks;
+  double x = std::min(change.changes, change.checks);
+
+  return -std::log((n - x + 0.5)/(n + 0.5)) * n / change.elapsed;
+}
+
+size_t Recrawl::slot(std::time_t due)
+{
+  if (due < wheel_time + granularity)
+    return cursor;
+
+  return (cursor + (due - wheel_time)/granularity) % wheel_size;
+}
+
+void Recrawl::place(uint64_t fp, Page& page)
+{
+  page.queued = false;
+  wheel[slot(page.due)].push_back(fp);
+}
+
+void Recrawl::schedule(uint64_t fp, Page& page)
+{
+  auto hostit = hosts.find(page.host);
+  double prior = (hostit == hosts.end()) ? -1.0 : estimate(hostit->second);
+  if (prior < 0.0) // the middle of the bounds on a log scale
+    prior = 1.0/std::sqrt(static_cast<double>(settings.min_interval)
+                          * settings.max_interval);
+
+  double own = estimate(page.change);
+  double n = page.change.checks;
+
+  double rate = (std::max(own, 0.0)*n + prior*prior_checks)/(n + prior_checks);
+  page.rate = static_cast<float>(rate);
+
+  double interval = static_cast<double>(settings.max_interval);
+  if (rate > 0.0)
+    interval = std::min(interval, 1.0/rate);
+  interval = std::max(interval, static_cast<double>(settings.min_interval));
+
+  page.due = page.last + static_cast<std::time_t>(interval);
+  place(fp, page);
+}
+
+void Recrawl::remove_host(const Page& page)
+{
+  auto it = hosts.find(page.host);
+  if (it == hosts.end())
+    return;
+
+  it->second.checks -= std::min(it->second.checks, page.change.checks);
+  it->second.changes -= std::min(it->second.changes, page.change.changes);
+  it->second.elapsed -= page.change.elapsed;
+
+  if (it->second.checks == 0)
+    hosts.erase(it);
+}
+
+bool Recrawl::observe(const std::string& url,
+                      const std::string& host,
+                      uint64_t digest,
+                      std::time_t now)
+{
+  uint64_t fp = fnv1a(url);
+
+  auto it = pages.find(fp);
+  if (it == pages.end()) {
+    Page& page = pages[fp];
+    page = {url, host, digest, {0, 0, 0.0}, now, 0, false, 0.0f};
+    schedule(fp, page);
+    return false;
+  }
+
+  Page& page = it->second;
+  bool changed = (digest != page.digest);
+  double elapsed = static_cast<double>(std::max(now - page.last, std::time_t(1)));
+
+  page.change.checks++;
+  page.change.changes += changed;
+  page.change.elapsed += elapsed;
+
+  Change& host_change = hosts[page.host];
+  host_change.checks++;
+  host_change.changes += changed;
+  host_change.elapsed += elapsed;
+
+  page.digest = digest;
+  page.last = now;
+  schedule(fp, page);
+
+  return changed;
+}
+
+void Recrawl::postpone(const std::string& url, std::time_t now)
+{
+  uint64_t fp = fnv1a(url);
+
+  auto it = pages.find(fp);
+  if (it == pages.end())
+    return;
+
+  it->second.due = now + settings.min_interval;
+  place(fp, it->second);
+}
+
+void Recrawl::forget(const std::string& url)
+{
+  auto it = pages.find(fnv1a(url));
+  if (it == pages.end())
+    return;
+
+  remove_host(it->second);
+  pages.erase(it); // its wheel positions become stale
+}
+
+void Recrawl::advance(std::time_t now)
+{
+  std::vector<uint64_t> fps;
+
+  /*
+   * A long stall is caught up over several calls,
+   * one turn of the wheel at most per call
+   */
+  for (unsigned int steps = 0;
+       wheel_time + granularity <= now && steps < wheel_size;
+       steps++) {
+    fps.clear();
+    fps.swap(wheel[cursor]);
+
+    const std::time_t slot_end = wheel_time + granularity;
+
+    for (auto fp : fps) {
+      auto it = pages.find(fp);
+      if (it == pages.end() || it->second.queued)
+        continue;
+
+      Page& page = it->second;
+      if (page.due < slot_end) {
+        page.queued = true;
+        ready_fps.push_back(fp);
+      } else if ((cursor + (page.due - wheel_time)/granularity) % wheel_size == cursor) {
+        // due within a next turn
+        wheel[cursor].push_back(fp);
+      }
+      // otherwise the page was moved since
+    }
+
+    cursor = (cursor + 1) % wheel_size;
+    wheel_time = slot_end;
+  }
+}
+
+bool Recrawl::pop(std::time_t now, std::string& url, std::string& host)
+{
+  while (!ready_fps.empty()) {
+    uint64_t fp = ready_fps.front();
+    ready_fps.pop_front();
+
+    auto it = pages.find(fp);
+    if (it == pages.end() || !it->second.queued)
+      continue;
+
+    Page& page = it->second;
+    url = page.url;
+    host = page.host;
+
+    // in case the fetch result is lost
+    page.due = now + settings.max_interval;
+    place(fp, page);
+
+    return true;
+  }
+
+  return false;
+}
+
+double Recrawl::rate(const std::string& url)
+{
+  auto it = pages.find(fnv1a(url));
+  return it == pages.end() ? 0.0 : it->second.rate;
+}
+
+/*
+ * The copy of a page is up to date if no change happened
+ * since its last fetch, with a probability exp(-rate*age)
+ */
+double Recrawl::expected_fresh(std::time_t now)
+{
+  double sum {0.0};
+  for (auto& page : pages)
+    sum += std::exp(-static_cast<double>(page.second.rate)
+                    * static_cast<double>(now - page.second.last));
+  return sum;
+}
+
+typedef struct SavedPage {
+  uint64_t digest;
+  uint32_t checks;
+  uint32_t changes;
+  double elapsed;
+  int64_t last;
+} SavedPage;
+
+std::string Recrawl::save(const std::string& url)
+{
+  auto it = pages.find(fnv1a(url));
+  if (it == pages.end())
+    return std::string();
+
+  const Page& page = it->second;
+  SavedPage saved {page.digest,
+                   page.change.checks,
+                   page.change.changes,
+                   page.change.elapsed,
+                   static_cast<int64_t>(page.last)};
+
+  std::string state(reinterpret_cast<const char*>(&saved), sizeof(SavedPage));
+  state.append(page.host);
+  return state;
+}
+
+void Recrawl::load(const std::string& url, const std::string& state, std::time_t now)
+{
+  if (state.size() < sizeof(SavedPage))
+    return;
+
+  SavedPage saved;
+  std::memcpy(&saved, state.data(), sizeof(SavedPage));
+
+  uint64_t fp = fnv1a(url);
+  if (pages.find(fp) != pages.end())
+    return;
+
+  Page& page = pages[fp];
+  page = {url,
+          state.substr(sizeof(SavedPage)),
+          saved.digest,
+          {saved.checks, saved.changes, saved.elapsed},
+          static_cast<std::time_t>(std::min<int64_t>(saved.last, now)),
+          0,
+          false,
+          0.0f};
+
+  Change& host_change = hosts[page.host];
+  host_change.checks += page.change.checks;
+  host_change.changes += page.change.changes;
+  host_change.elapsed += page.change.elapsed;
+
+  schedule(fp, page);
+}
+
+} // namespace mermoz
@@ -0,0 +1,171 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_RECRAWL_H__
+#define MERMOZ_RECRAWL_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+#include <ctime>
+
+#include "urlserver/checkpoint.hpp"
+
+namespace mermoz
+{
+
+typedef struct RecrawlSettings {
+  float share; // of the dispatched URLs given to refresh, 0 disables it
+  long min_interval; // seconds
+  long max_interval; // seconds
+} RecrawlSettings;
+
+/*! \brief Freshness metrics shared by the urlserver shards */
+class RecrawlStats
+{
+public:
+  RecrawlStats(unsigned int num_shards) :
+    refreshed(0),
+    changed(0),
+    tracked(num_shards),
+    fresh(num_shards) {}
+
+  std::atomic<uint64_t> refreshed; // pages fetched again
+  std::atomic<uint64_t> changed; // of which the content changed
+
+  std::vector<std::atomic<uint64_t>> tracked; // pages per shard
+  std::vector<std::atomic<uint64_t>> fresh; // expected up to date per shard
+
+  uint64_t num_tracked();
+
+  /*! Expected share of the tracked pages whose copy is still up to date */
+  float freshness();
+}; // class RecrawlStats
+
+/*! \brief Schedules the visits again of the fetched pages
+ *
+ * Each page keeps the digest of its content, the number of checks and
+ * of changes seen. Changes are a Poisson process whose rate is estimated
+ * per page and per host, the host rate is the prior of the pages
+ * checked few times. A page is due after '1/rate' seconds, bounded.
+ *
+ * Due dates are kept within a hashed timing wheel of 'wheel_size' slots
+ * of 'granularity' seconds, later dates stay in their slot for the
+ * next turns. Insertion is O(1) and a tick only scans one slot.
+ */
+class Recrawl
+{
+public:
+  Recrawl(const RecrawlSettings& settings, std::time_t now);
+
+  /*! A fetch of 'url' gave a content of 'digest', returns true if it changed */
+  bool observe(const std::string& url,
+               const std::string& host,
+               uint64_t digest,
+               std::time_t now);
+
+  /*! The fetch failed for a while, the page is tried again later */
+  void postpone(const std::string& url, std::time_t now);
+
+  /*! The page is gone */
+  void forget(const std::string& url);
+
+  /*! Moves the due pages to the ready list */
+  void advance(std::time_t now);
+
+  bool ready()
+  {
+    return !ready_fps.empty();
+  }
+
+  /*! Next due page, it waits for 'observe' or is due again after the max interval */
+  bool pop(std::time_t now, std::string& url, std::string& host);
+
+  /*! Estimated changes per second of a page, 0 if unknown */
+  double rate(const std::string& url);
+
+  /*! Expected number of pages whose copy is still up to date */
+  double expected_fresh(std::time_t now);
+
+  size_t size()
+  {
+    return pages.size();
+  }
+
+  /*! Serialized page for 'Checkpoint::log_state', empty if unknown */
+  std::string save(const std::string& url);
+
+  /*! Page restored from a checkpoint */
+  void load(const std::string& url, const std::string& state, std::time_t now);
+
+  static const char state_kind {'C'};
+
+  static const unsigned int wheel_size {4096};
+  static const long granularity {60}; // seconds per slot
+
+private:
+  typedef struct Change {
+    uint32_t checks; // fetches after the first one
+    uint32_t changes; // checks which found a new content
+    double elapsed; // seconds between the first and last fetches
+  } Change;
+
+  typedef struct Page {
+    std::string url;
+    std::string host;
+    uint64_t digest;
+    Change change;
+    std::time_t last; // last fetch
+    std::time_t due;
+    bool queued; // within the ready list
+    float rate; // changes per second
+  } Page;
+
+  const RecrawlSettings settings;
+
+  std::unordered_map<uint64_t, Page> pages;
+  std::unordered_map<std::string, Change> hosts;
+
+  std::vector<std::vector<uint64_t>> wheel;
+  std::time_t wheel_time; // start of the current slot
+  size_t cursor;
+
+  std::deque<uint64_t> ready_fps;
+
+  double estimate(const Change& change);
+  void schedule(uint64_t fp, Page& page);
+  void place(uint64_t fp, Page& page);
+  size_t slot(std::time_t due);
+  void remove_host(const Page& page);
+}; // class Recrawl
+
+} // namespace mermoz
+
+#endif // MERMOZ_RECRAWL_H__
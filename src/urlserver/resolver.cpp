@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/resolver.hpp"
+
+#include <cstring>
+
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common/common.hpp"
+
+namespace mermoz
+{
+
+Resolver::Resolver(bool* status, unsigned int num_threads) :
+  status(status)
+{
+  for (unsigned int t_id = 0; t_id < num_threads; t_id++)
+    workers.push_back(std::thread(worker, this));
+}
+
+Resolver::~Resolver()
+{
+  for (auto& t : workers)
+    t.join();
+}
+
+bool Resolver::try_get(std::string& host, std::string& ip)
+{
+  std::string result;
+  if (!results.try_pop(result))
+    return false;
+
+  unpack(result, {&host, &ip});
+  return true;
+}
+
+void Resolver::worker(Resolver* resolver)
+{
+  std::string host;
+
+  while (*resolver->status) {
+    if (!resolver->requests.pop_for(host, 1000L))
+      continue;
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    std::string ip;
+    struct addrinfo* res {nullptr};
+
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &res) == 0 && res != nullptr) {
+      char buffer[INET6_ADDRSTRLEN];
+      const void* addr {nullptr};
+
+      if (res->ai_family == AF_INET)
+        addr = &reinterpret_cast<struct sockaddr_in*>(res->ai_addr)->sin_addr;
+      else if (res->ai_family == AF_INET6)
+        addr = &reinterpret_cast<struct sockaddr_in6*>(res->ai_addr)->sin6_addr;
+
+      if (addr != nullptr
+          && inet_ntop(res->ai_family, addr, buffer, sizeof(buffer)) != nullptr)
+        ip = buffer;
+    }
+
+    if (res != nullptr)
+      freeaddrinfo(res);
+
+    std::string result;
+    pack(result, {&host, &ip});
+    resolver->results.push(result);
+  }
+}
+
+std::string Resolver::block(const std::string& ip)
+{
+  unsigned char addr[16];
+  char buffer[INET6_ADDRSTRLEN];
+
+  if (inet_pton(AF_INET, ip.c_str(), addr) == 1) {
+    addr[3] = 0;
+    inet_ntop(AF_INET, addr, buffer, sizeof(buffer));
+    return std::string(buffer) + "/24";
+  }
+
+  if (inet_pton(AF_INET6, ip.c_str(), addr) == 1) {
+    std::memset(addr + 6, 0, 10);
+    inet_ntop(AF_INET6, addr, buffer, sizeof(buffer));
+    return std::string(buffer) + "/48";
+  }
+
+  return std::string();
+}
+
+} // namespace mermoz
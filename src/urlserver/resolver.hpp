@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_RESOLVER_H__
+#define MERMOZ_RESOLVER_H__
+
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "tsafe/thread_safe_queue.h"
+#include "tsafe/thread_safe_notifier.h"
+
+namespace mermoz
+{
+
+/*! \brief Resolves host names aside of the dispatcher
+ *
+ * 'getaddrinfo' blocks, so a few threads take the requests
+ * and give back 'host' and its first address, empty if the
+ * host cannot be resolved.
+ */
+class Resolver
+{
+public:
+  Resolver(bool* status, unsigned int num_threads = 4);
+  ~Resolver();
+
+  /*! Wakes 'notifier' when a host is resolved */
+  void attach(thread_safe::notifier* notifier)
+  {
+    results.attach(notifier);
+  }
+
+  void resolve(const std::string& host)
+  {
+    requests.push(host);
+  }
+
+  bool try_get(std::string& host, std::string& ip);
+
+  /*! Returns the /24 block of an IPv4, the /48 of an IPv6 */
+  static std::string block(const std::string& ip);
+
+private:
+  bool* status;
+  thread_safe::queue<std::string> requests;
+  thread_safe::queue<std::string> results; // packed 'host' and 'ip'
+  std::vector<std::thread> workers;
+
+  static void worker(Resolver* resolver);
+}; // class Resolver
+
+} // namespace mermoz
+
+#endif // MERMOZ_RESOLVER_H__
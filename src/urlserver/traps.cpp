@@ -0,0 +1,145 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#include "urlserver/traps.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include "common/hashing.hpp"
+
+namespace mermoz
+{
+
+/*
+ * Shape of a path segment or of an argument name,
+ * identifiers are long mixes of letters and digits
+ */
+static void shape(const std::string& s, std::string& out)
+{
+  size_t digits {0};
+  for (char c : s)
+    if (std::isdigit(static_cast<unsigned char>(c)))
+      digits++;
+
+  if (s.size() >= 16 && digits > 0 && digits < s.size()) {
+    out.push_back('*');
+    return;
+  }
+
+  bool in_number {false};
+  for (char c : s) {
+    if (std::isdigit(static_cast<unsigned char>(c))) {
+      if (!in_number)
+        out.push_back('9');
+      in_number = true;
+    } else {
+      out.push_back(c);
+      in_number = false;
+    }
+  }
+}
+
+TrapDetector::TrapDetector(const TrapSettings& settings, TrapStats* stats) :
+  settings(settings),
+  stats(stats)
+{
+}
+
+std::string TrapDetector::pattern(urlfactory::UrlParser& up, const std::string& host)
+{
+  std::string p {host};
+
+  for (auto& seg : up.get_segments()) {
+    p.push_back('/');
+    shape(seg, p);
+  }
+
+  const std::vector<std::string>& args = up.get_arguments();
+  if (args.empty())
+    return p;
+
+  std::vector<std::string> names;
+  names.reserve(args.size());
+  for (auto& arg : args)
+    names.push_back(arg.substr(0, arg.find('=')));
+  std::sort(names.begin(), names.end());
+
+  char sep {'?'};
+  for (auto& name : names) {
+    p.push_back(sep);
+    shape(name, p);
+    sep = '&';
+  }
+
+  return p;
+}
+
+TrapDetector::Verdict TrapDetector::check(urlfactory::UrlParser& up, const std::string& host)
+{
+  const std::vector<std::string>& segments = up.get_segments();
+
+  if (settings.max_depth > 0
+      && (segments.size() > settings.max_depth
+          || up.get_arguments().size() > settings.max_depth)) {
+    stats->depth++;
+    return DEPTH;
+  }
+
+  if (settings.max_repeat > 0 && segments.size() > settings.max_repeat) {
+    std::unordered_map<std::string, unsigned int> seen;
+    for (auto& seg : segments)
+      if (!seg.empty() && ++seen[seg] > settings.max_repeat) {
+        stats->repeat++;
+        return REPEAT;
+      }
+  }
+
+  if (settings.pattern_max == 0)
+    return ADMIT;
+
+  if (patterns.size() >= max_patterns)
+    patterns.clear();
+
+  uint32_t& count = patterns[fnv1a(pattern(up, host))];
+  count++;
+
+  if (count <= settings.pattern_max)
+    return ADMIT;
+
+  if (count == settings.pattern_max + 1)
+    stats->patterns++;
+
+  if ((count - settings.pattern_max) % throttle == 0)
+    return ADMIT;
+
+  stats->throttled++;
+  return THROTTLED;
+}
+
+} // namespace mermoz
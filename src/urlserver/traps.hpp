@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+#ifndef MERMOZ_TRAPS_H__
+#define MERMOZ_TRAPS_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+
+#include "urlfactory/urlfactory.hpp"
+
+namespace mermoz
+{
+
+typedef struct TrapSettings {
+  unsigned int max_depth; // path segments or query arguments, 0 if not limited
+  unsigned int max_repeat; // occurrences of a same path segment, 0 if not limited
+  unsigned int pattern_max; // URLs per pattern before throttling, 0 if not limited
+} TrapSettings;
+
+/*! \brief URLs dropped by the trap detectors of all the shards,
+ * each of them is a fetch saved
+ */
+typedef struct TrapStats {
+  std::atomic<uint64_t> repeat;
+  std::atomic<uint64_t> depth;
+  std::atomic<uint64_t> throttled;
+  std::atomic<uint64_t> patterns; // throttled patterns
+} TrapStats;
+
+/*! \brief Finds the URLs of infinite URL spaces
+ *
+ * Calendars, session identifiers within the path or relative links
+ * resolved again and again give endless URLs. A URL is a trap if a path
+ * segment comes back too often (/a/b/a/b/a/b) or if it is too deep.
+ * Each URL also has a pattern, its host and the shape of its path and
+ * query: digits and identifiers are erased and only the names of the
+ * arguments are kept. Past 'pattern_max' URLs only one URL out of
+ * 'throttle' of a pattern is admitted.
+ */
+class TrapDetector
+{
+public:
+  enum Verdict {
+    ADMIT,
+    REPEAT,
+    DEPTH,
+    THROTTLED
+  };
+
+  TrapDetector(const TrapSettings& settings, TrapStats* stats);
+
+  /*! Checks a new URL of 'host', counts it within its pattern if admitted */
+  Verdict check(urlfactory::UrlParser& up, const std::string& host);
+
+  /*! Approximate memory used by the patterns */
+  size_t memory() const
+  {
+    return patterns.size()*pattern_mem;
+  }
+
+  /*! The pattern of a URL, digits become '9' and identifiers '*' */
+  static std::string pattern(urlfactory::UrlParser& up, const std::string& host);
+
+private:
+  static const unsigned int throttle {16};
+  static const size_t pattern_mem {32};
+  // a pattern map larger than that is reset, patterns are counted again
+  static const size_t max_patterns {1UL << 22};
+
+  TrapSettings settings;
+  TrapStats* stats;
+
+  std::unordered_map<uint64_t, uint32_t> patterns;
+}; // class TrapDetector
+
+} // namespace mermoz
+
+#endif // MERMOZ_TRAPS_H__
@@ -31,214 +31,859 @@
 #include <curl/curl.h>
 #include <ctime>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <list>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "urlserver/checkpoint.hpp"
+#include "urlserver/frontier.hpp"
+#include "urlserver/recrawl.hpp"
+#include "urlserver/resolver.hpp"
 
 namespace mermoz
 {
 
 void urlserver(bool* status,
+               unsigned int shard_id,
                UrlServerSettings* usets,
-               TSQueueVector* content_queues,
-               TSQueueVector* url_queues)
+               ParseRing* content_queue,
+               FetchQueueVector* url_queues)
 {
   std::signal(SIGPIPE, SIG_IGN);
 
-  std::set<std::string> visited;
-  std::set<std::string> to_visit;
-  std::set<std::string> parsed_urls;
+  /*
+   * URLs are known by their fingerprints once
+   * they were sent to the fetchers
+   */
+  VisitedSet visited;
+  std::unordered_set<uint64_t> to_visit;
+
+  /*
+   * Allowed URLs wait within the frontier, the others
+   * wait for the 'robots.txt' of their host
+   */
+  Frontier frontier(usets->weights);
+  std::map<std::string, std::vector<FrontierEntry>> robots_waiting;
+  std::unordered_set<uint64_t> waiting_fps;
 
   std::map<std::string, urlfactory::Robots> robots;
   std::queue<std::string> robots_queue;
+  std::set<std::string> robots_unsaved;
   const size_t robots_limit {100000};
 
-  thread_safe::queue<std::string> allowed_queue;
+  // enough URLs of various hosts for the dispatcher
+  const size_t dispatch_window {16*url_queues->size()};
+  // URLs held by the dispatcher for their busy host
+  const size_t max_deferred {64*dispatch_window};
+
+  std::unique_ptr<Checkpoint> ckpt;
+
+  /*
+   * Fetched pages are visited again if a share
+   * of the fetches is given to refresh
+   */
+  std::unique_ptr<Recrawl> recrawl;
+  std::unordered_set<uint64_t> refreshing;
+  uint64_t num_new {0};
+  uint64_t num_refresh {0};
+  std::time_t last_stats {0};
+
+  if (usets->recrawl.share > 0.0f)
+    recrawl.reset(new Recrawl(usets->recrawl, std::time(nullptr)));
+
+  /*
+   * Arguments learned as useless per host
+   * are stripped from the new links
+   */
+  std::unique_ptr<DustRules> dust;
+  std::time_t last_dust {0};
+
+  if (usets->dust_min > 0)
+    dust.reset(new DustRules(usets->dust_min));
+
+  // the rules and samples are charged as they grow
+  auto dust_mem = [&](size_t before) {
+    if (dust->memory() >= before)
+      (*usets->mem_sec) += dust->memory() - before;
+    else
+      (*usets->mem_sec) -= before - dust->memory();
+  };
+
+  /*
+   * Pages and bytes fetched per registrable domain, a domain
+   * out of its budget does not get any new URL
+   */
+  typedef struct DomainUse {
+    uint64_t pages;
+    uint64_t bytes;
+    bool exhausted;
+  } DomainUse;
+
+  const DomainBudget& budget = usets->budget;
+  const bool domain_budget {budget.max_pages > 0 || budget.max_bytes > 0};
+  std::unordered_map<std::string, DomainUse> domains;
+
+  auto domain_use = [&](const std::string& host) -> DomainUse& {
+    std::string domain {usets->suffixes->registrable_domain(host)};
+
+    auto res = domains.emplace(domain, DomainUse {0, 0, false});
+    if (res.second)
+      (*usets->mem_sec) += domain.size() + sizeof(DomainUse);
+
+    return res.first->second;
+  };
+
+  // infinite URL spaces (calendars, session paths, loops)
+  TrapDetector traps(usets->traps, usets->trap_stats);
+
+  auto check_budget = [&](DomainUse& use, const std::string& host) {
+    if (use.exhausted
+        || !((budget.max_pages > 0 && use.pages >= budget.max_pages)
+             || (budget.max_bytes > 0 && use.bytes >= budget.max_bytes)))
+      return;
+
+    use.exhausted = true;
+    print_warning("Budget: " + usets->suffixes->registrable_domain(host)
+                  + " exhausted after " + std::to_string(use.pages) + " pages and "
+                  + std::to_string(use.bytes >> 20) + " MB");
+  };
+
+  /*
+   * Gives an URL to the frontier if its host 'robots.txt'
+   * is known, the URL waits for it otherwise
+   */
+  auto enqueue = [&](FrontierEntry& entry, uint64_t fp) {
+    std::map<std::string, urlfactory::Robots>::iterator mapit;
+
+    if ((mapit = robots.find(entry.host)) == robots.end()) {
+      if (robots_queue.size() > robots_limit) {
+        robots.erase(robots_queue.front());
+        robots_unsaved.erase(robots_queue.front());
+        robots_queue.pop();
+      }
+
+      urlfactory::UrlParser up(entry.url);
+      mapit = robots.emplace(entry.host,
+                             urlfactory::Robots(up.get_url(true, true, false, false, false),
+                                                "Qwantify",
+                                                usets->user_agent)
+                            ).first;
+
+      // the raw file is only needed by the checkpoint
+      if (ckpt) {
+        mapit->second.keep_robotstxt();
+        robots_unsaved.insert(entry.host);
+      }
+
+      mapit->second.async_init();
+
+      robots_queue.push(entry.host);
+    }
+
+    if (!mapit->second.tried()) {
+      waiting_fps.insert(fp);
+      robots_waiting[entry.host].push_back(std::move(entry));
+      return;
+    }
+
+    urlfactory::UrlParser up(entry.url);
+
+    if (mapit->second.good() && mapit->second.is_allowed(up)) {
+      frontier.push(entry, fp);
+    } else {
+      if (ckpt)
+        ckpt->log_drop(fp);
+      (*usets->mem_sec) -= entry.url.size();
+    }
+  };
+
+  /*
+   * New link found with the 'meta' of its page, or restored,
+   * nothing is copied from the batch until the link is new.
+   * Without parent host, restored or forwarded by a peer,
+   * 'meta' is already the one of the link
+   */
+  auto add_link = [&](const Link& found,
+                      const CrawlMeta& meta,
+                      uint64_t parent_host_id,
+                      bool restored) {
+    if (budget.max_depth > 0 && meta.depth > budget.max_depth)
+      return;
+
+    // restored URLs were stripped when found
+    Link link {found};
+    std::string stripped;
+    if (dust && !restored
+        && dust->strip(found.url, found.url_size, found.host_id, stripped)) {
+      link.url = stripped.data();
+      link.url_size = stripped.size();
+      link.fp = fnv1a(stripped);
+    }
+
+    // what a link already in the frontier merges is its own meta
+    CrawlMeta link_meta {meta};
+    if (parent_host_id != 0 && link.host_id != parent_host_id)
+      link_meta.host_hops++;
+
+    if (link.host_size == 0
+        || visited.contains(link.fp)
+        || to_visit.find(link.fp) != to_visit.end()
+        || waiting_fps.find(link.fp) != waiting_fps.end()
+        || frontier.merge(link.fp, link_meta))
+      return;
+
+    FrontierEntry entry {std::string(link.url, link.url_size),
+                         std::string(link.host, link.host_size),
+                         link_meta};
+
+    if (domain_budget && domain_use(entry.host).exhausted) {
+      if (ckpt && restored)
+        ckpt->log_drop(link.fp);
+      return;
+    }
+
+    if (usets->cluster != nullptr
+        && !usets->cluster->owns(entry.host)) {
+      // another node crawls this host
+      usets->cluster->forward(entry.host, entry.url, entry.meta);
+      if (ckpt && restored)
+        ckpt->log_drop(link.fp);
+      return;
+    }
+
+    urlfactory::UrlParser up(entry.url);
+    size_t trap_mem {traps.memory()};
+    TrapDetector::Verdict verdict {traps.check(up, entry.host)};
+    if (traps.memory() >= trap_mem)
+      (*usets->mem_sec) += traps.memory() - trap_mem;
+    else
+      (*usets->mem_sec) -= trap_mem - traps.memory();
+
+    if (verdict != TrapDetector::ADMIT) {
+      if (ckpt && restored)
+        ckpt->log_drop(link.fp);
+      return;
+    }
+
+    if (ckpt && !restored)
+      ckpt->log_frontier(entry.url);
+
+    (*usets->mem_sec) += entry.url.size();
+    enqueue(entry, link.fp);
+  };
+
+  if (!usets->checkpoint_dir.empty()) {
+    ckpt.reset(new Checkpoint(usets->checkpoint_dir,
+                              shard_id,
+                              usets->num_shards,
+                              usets->checkpoint_interval,
+                              usets->mem_sec));
+
+    std::vector<std::string> frontier_urls;
+    std::map<std::string, RobotsEntry> saved_robots;
+    StateMap states;
+
+    if (!usets->resume) {
+      ckpt->reset();
+    } else if (ckpt->restore(visited, frontier_urls, saved_robots, states)) {
+      for (auto& entry : saved_robots) {
+        urlfactory::UrlParser up(entry.first);
+
+        auto res = robots.emplace(up.get_host(),
+                                  urlfactory::Robots(entry.first,
+                                                     "Qwantify",
+                                                     usets->user_agent));
+        if (res.second) {
+          res.first->second.load(entry.second.robotstxt, entry.second.http_code);
+          robots_queue.push(up.get_host());
+        }
+      }
+
+      std::time_t now = std::time(nullptr);
+      size_t before = dust ? dust->memory() : 0;
+
+      for (auto& state : states)
+        if (recrawl && state.first[0] == Recrawl::state_kind) {
+          recrawl->load(state.first.substr(1), state.second, now);
+          (*usets->mem_sec) += 2*state.first.size();
+        } else if (dust && state.first[0] == DustRules::state_kind) {
+          dust->load(state.first.substr(1), state.second);
+        }
+
+      if (dust)
+        dust_mem(before);
+
+      // the crawl meta is not saved, restored URLs are like seeds
+      CrawlMeta meta;
+      unpack_meta("", meta);
+
+      LinkBatchWriter writer;
+      for (auto& url : frontier_urls)
+        writer.add(url, urlfactory::UrlParser(url).get_host());
+      frontier_urls.clear();
+
+      std::string flat;
+      writer.write(flat);
+      writer.clear();
+
+      LinkBatch batch(flat);
+      for (size_t i = 0; i < batch.size(); i++)
+        add_link(batch[i], meta, 0, true);
+    } else {
+      /*
+       * Starting empty would erase the files at the first snapshot,
+       * they are kept for a resume once the cause is fixed
+       */
+      print_error("Checkpoint: shard " + std::to_string(shard_id)
+                  + " cannot be restored, the crawl stops");
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  DispatchQueues dispatch;
 
   std::thread t(dispatcher,
                 status,
-                &allowed_queue,
-                url_queues);
+                shard_id,
+                usets,
+                &dispatch);
   t.detach();
 
-  unsigned int parser_id {0};
+  std::unique_ptr<ParseResult> result;
+
+  // results popped at once from the ring, 'drained' of them were handled
+  std::vector<std::unique_ptr<ParseResult>> popped;
+  size_t drained {0};
 
   while (*status) {
-    if (!content_queues->at(parser_id).empty()) {
-      std::string content;
-      content_queues->at(parser_id).pop(content);
+    if (ckpt)
+      ckpt->tick();
+
+    /*
+     * Sleeps until a parser pushes something, or until a robots
+     * file some URLs are waiting for may have been fetched
+     */
+    long time_out = (robots_waiting.empty() && frontier.empty()
+                     && !(recrawl && recrawl->ready())) ? 1000L : 50L;
+    bool received = content_queue->pop_for(result, time_out);
+
+    while (received) {
+      (*usets->mem_sec) -= result->size();
+
+      std::string& url = result->url;
+      std::string& eff_url = result->eff_url;
+      std::string& links = result->links;
+      long http_code = result->http_status;
+      std::string& host = result->host;
+      std::string& meta_pack = result->meta;
+      uint64_t digest = result->digest;
+
+      /*
+       * 'url' and 'eff_url' are only given to
+       * the shard which owns their host
+       */
+      if (!url.empty()) {
+        uint64_t fp = fnv1a(url);
+
+        // its host may fetch one more URL
+        dispatch.done.push({fp, http_code, result->latency});
+
+        if (to_visit.erase(fp) > 0)
+          (*usets->mem_sec) -= sizeof(uint64_t);
+
+        bool fetched = http_code >= 200 && http_code < 300;
+
+        // 'digest' is only given for the pages fetched
+        if (dust && fetched) {
+          size_t before = dust->memory();
+          dust->observe(url, urlfactory::UrlParser(url).get_host(), digest);
+          dust_mem(before);
+        }
 
-      (*usets->mem_sec) -= content.size();
+        if (domain_budget && result->content_size > 0) {
+          std::string url_host {urlfactory::UrlParser(url).get_host()};
+          DomainUse& use = domain_use(url_host);
+          use.bytes += result->content_size;
+          check_budget(use, url_host);
+        }
 
-      std::string url;
-      std::string eff_url;
-      std::string text;
-      std::string links;
-      std::string http_status;
+        if (visited.insert(fp)) {
+          (*usets->mem_sec) += sizeof(uint64_t);
+          if (ckpt)
+            ckpt->log_visited(fp);
+        }
 
-      unpack(content, {&url, &eff_url, &http_status, &text, &links});
+        if (recrawl) {
+          bool refresh = refreshing.erase(fp) > 0;
+          size_t tracked = recrawl->size();
+
+          if (result->alias != 0) {
+            // the first URL with this content is the one refreshed
+            recrawl->forget(url);
+            if (ckpt)
+              ckpt->log_state(Recrawl::state_kind, url, "");
+          } else if (fetched) {
+            bool changed = recrawl->observe(url,
+                                            urlfactory::UrlParser(url).get_host(),
+                                            digest,
+                                            std::time(nullptr));
+            if (refresh) {
+              usets->recrawl_stats->refreshed++;
+              if (changed)
+                usets->recrawl_stats->changed++;
+            }
+            if (ckpt)
+              ckpt->log_state(Recrawl::state_kind, url, recrawl->save(url));
+          } else if (http_code < 100 || http_code == 429 || http_code >= 500) {
+            // transient, the page may come back
+            recrawl->postpone(url, std::time(nullptr));
+          } else {
+            recrawl->forget(url);
+            if (ckpt)
+              ckpt->log_state(Recrawl::state_kind, url, "");
+          }
 
-      std::set<std::string>::iterator it;
-      if ((it = to_visit.find(url)) != to_visit.end()) {
-        to_visit.erase(it);
-        (*usets->mem_sec) -= url.size();
+          if (recrawl->size() > tracked)
+            (*usets->mem_sec) += 2*url.size();
+          else if (recrawl->size() < tracked)
+            (*usets->mem_sec) -= 2*url.size();
+        }
       }
 
-      (*usets->mem_sec) += url.size();
-      visited.insert(url);
-
-      if (url.compare(eff_url) != 0) {
+      if (!eff_url.empty() && url.compare(eff_url) != 0) {
         /*
          * One considers that URLs differs (redirection)
          * and this must be saved
          */
-        visited.insert(eff_url);
+        uint64_t fp = fnv1a(eff_url);
+
+        if (visited.insert(fp)) {
+          (*usets->mem_sec) += sizeof(uint64_t);
+          if (ckpt)
+            ckpt->log_visited(fp);
+        }
       }
 
-      std::string link;
-      std::istringstream iss(links);
+      CrawlMeta meta;
+      unpack_meta(meta_pack, meta);
 
-      while(!iss.eof()) {
-        std::getline(iss, link);
+      // links forwarded by a peer come without host
+      const uint64_t host_id = host.empty() ? 0 : fnv1a(host);
 
-        if (link.size() > 1) {
-          if (visited.find(link) == visited.end()
-              && to_visit.find(link) == to_visit.end()
-              && parsed_urls.find(link) == parsed_urls.end()) {
-            (*usets->mem_sec) += link.size();
-            parsed_urls.insert(link);
-          }
-        }
+      LinkBatch batch(links);
+      for (size_t i = 0; i < batch.size(); i++)
+        add_link(batch[i], meta, host_id, false);
+
+      /*
+       * Drains what is already available before dispatching
+       */
+      if (drained == popped.size()) {
+        popped.clear();
+        drained = 0;
+        content_queue->try_pop_batch(popped, 64);
+      }
+
+      received = drained < popped.size();
+      if (received)
+        result = std::move(popped[drained++]);
+    }
+
+    /*
+     * Fetched 'robots.txt' are logged and forgotten at once,
+     * even those no URL waits for anymore
+     */
+    for (auto unsaved = robots_unsaved.begin();
+         unsaved != robots_unsaved.end();) {
+      auto mapit = robots.find(*unsaved);
+
+      if (mapit != robots.end() && !mapit->second.tried()) {
+        unsaved++;
+        continue;
       }
+
+      if (mapit != robots.end())
+        ckpt->log_robots(mapit->second.get_host(),
+                         mapit->second.get_http_code(),
+                         mapit->second.take_robotstxt());
+
+      unsaved = robots_unsaved.erase(unsaved);
     }
 
-    parser_id++;
-    if (parser_id >= content_queues->size()) {
-      parser_id = 0;
+    // URLs waiting for their 'robots.txt'
+    for (auto waitit = robots_waiting.begin();
+         waitit != robots_waiting.end();) {
+      auto mapit = robots.find(waitit->first);
+
+      if (mapit != robots.end() && !mapit->second.tried()) {
+        waitit++;
+        continue;
+      }
+
+      /*
+       * The 'robots.txt' is known, or it was evicted
+       * and will be fetched again by 'enqueue'
+       */
+      std::vector<FrontierEntry> entries;
+      entries.swap(waitit->second);
+      waitit = robots_waiting.erase(waitit);
+
+      for (auto& entry : entries) {
+        uint64_t fp = fnv1a(entry.url);
+        waiting_fps.erase(fp);
+        enqueue(entry, fp);
+      }
     }
 
-    // dispatching tasks
-    for(auto purlit = parsed_urls.begin();
-        purlit != parsed_urls.end();) {
-      urlfactory::UrlParser up(*purlit);
+    std::time_t now = std::time(nullptr);
 
-      std::map<std::string, urlfactory::Robots>::iterator mapit;
+    if (recrawl) {
+      recrawl->advance(now);
 
-      if ((mapit = robots.find(up.get_host())) == robots.end()) {
-        if (robots_queue.size() > robots_limit) {
-          robots.erase(robots_queue.front());
-          robots_queue.pop();
-        }
+      if (now - last_stats >= 10) {
+        usets->recrawl_stats->tracked[shard_id] = recrawl->size();
+        usets->recrawl_stats->fresh[shard_id] =
+          static_cast<uint64_t>(recrawl->expected_fresh(now));
+        last_stats = now;
+      }
+
+      // only the recent dispatches count for the share
+      if (num_new + num_refresh > 10000) {
+        num_new /= 2;
+        num_refresh /= 2;
+      }
+    }
 
-        robots.emplace(up.get_host(),
-                       urlfactory::Robots(up.get_url(true, true, false, false, false),
-                                          "Qwantify",
-                                          usets->user_agent)
-                      );
+    if (dust && now - last_dust >= 10) {
+      if (ckpt)
+        dust->save_changed([&](const std::string& key, const std::string& state) {
+          ckpt->log_state(DustRules::state_kind, key, state);
+        });
 
-        robots[up.get_host()].async_init();
+      if (usets->dust_report != nullptr) {
+        std::ostringstream oss;
+        dust->report(oss);
+        usets->dust_report->set(shard_id, oss.str());
+      }
+      last_dust = now;
+    }
+
+    // dispatching the best URLs, or the due ones for their share
+    FrontierEntry entry;
+    while (dispatch.allowed.size() < dispatch_window
+           && dispatch.num_deferred < max_deferred) {
+      bool refresh = recrawl && recrawl->ready()
+                     && (frontier.empty()
+                         || num_refresh < usets->recrawl.share*(num_new + num_refresh + 1));
+
+      if (refresh) {
+        if (!recrawl->pop(now, entry.url, entry.host))
+          continue;
 
-        robots_queue.push(up.get_host());
+        /*
+         * The page already gave its cash, its new
+         * links are near the top of the crawl
+         */
+        entry.meta = {0, 0, 0.0f};
+        num_refresh++;
 
-        purlit++;
+        refreshing.insert(fnv1a(entry.url));
+      } else if (frontier.pop(entry)) {
+        num_new++;
+        (*usets->mem_sec) -= entry.url.size();
       } else {
-        if (mapit->second.tried()) {
-          if (mapit->second.good()) {
-            if (mapit->second.is_allowed(up)
-                && to_visit.find(*purlit) == to_visit.end()) {
-
-              std::string content;
-              std::string host {up.get_host()};
-              std::string url {*purlit};
-
-              if (!host.empty()) {
-                pack(content, {&host, &url});
-                (*usets->mem_sec) += content.size();
-                allowed_queue.push(content);
-
-                (*usets->mem_sec) += purlit->size();
-                to_visit.insert(*purlit);
-              }
-            }
-          }
+        break;
+      }
+
+      uint64_t fp = fnv1a(entry.url);
+
+      /*
+       * Pages fetched again were already paid by their
+       * domain, the new ones are counted when sent
+       */
+      if (domain_budget && !refresh) {
+        DomainUse& use = domain_use(entry.host);
+
+        if (use.exhausted) {
+          if (ckpt)
+            ckpt->log_drop(fp);
+          continue;
+        }
+
+        use.pages++;
+        check_budget(use, entry.host);
+      }
 
-          (*usets->mem_sec) -= purlit->size();
-          purlit = parsed_urls.erase(purlit);
-        } else {
-          purlit++;
-        } // if (mapit->second.good())
-      } // if (mapit == robots.end())
-    } // for (auto& purlit : parsed_urls)
+      if (usets->cluster != nullptr
+          && !usets->cluster->owns(entry.host)) {
+        /*
+         * A node joined the crawl and
+         * took this host, the URL moves
+         */
+        usets->cluster->forward(entry.host, entry.url, entry.meta);
+        if (ckpt)
+          ckpt->log_drop(fp);
+        if (refresh) {
+          refreshing.erase(fp);
+          recrawl->forget(entry.url);
+          (*usets->mem_sec) -= 2*entry.url.size();
+          if (ckpt)
+            ckpt->log_state(Recrawl::state_kind, entry.url, "");
+        }
+        continue;
+      }
+
+      std::unique_ptr<FetchTask> task(new FetchTask {entry.host, entry.url, "", ""});
+      pack_meta(task->meta, entry.meta);
+
+      (*usets->mem_sec) += task->size();
+      dispatch.allowed.push(std::move(task));
+
+      if (!refresh) {
+        (*usets->mem_sec) += sizeof(uint64_t);
+        to_visit.insert(fp);
+      }
+    }
   } // while (*status)
 }
 
 void dispatcher(bool* status,
-                thread_safe::queue<std::string>* allowed_queue,
-                TSQueueVector* url_queues)
+                unsigned int shard_id,
+                UrlServerSettings* usets,
+                DispatchQueues* queues)
 {
-  std::map<std::string, std::pair<unsigned int, unsigned int>> history_map;
-  std::queue<std::string> history_order;
+  typedef struct InFlight {
+    std::string host;
+    std::string block;
+    std::time_t sent;
+  } InFlight;
+
+  typedef struct IpBlock {
+    unsigned int in_flight;
+    std::deque<std::string> waiting; // hosts, in order
+  } IpBlock;
+
+  std::unordered_map<std::string, HostControl> hosts;
+  std::unordered_map<std::string, IpBlock> blocks;
+  std::unordered_map<uint64_t, InFlight> in_flight;
+  std::deque<std::pair<std::time_t, uint64_t>> sent_order;
+  std::deque<std::pair<std::time_t, std::string>> idle_order;
+
+  // a fetch whose result never came back does not hold its host forever
+  const std::time_t in_flight_timeout {300};
+  // the window and the address of an idle host are kept for a while
+  const std::time_t idle_timeout {600};
+  std::time_t last_report {0};
+
+  thread_safe::notifier notifier;
+  queues->allowed.attach(&notifier);
+  queues->done.attach(&notifier);
+
+  /*
+   * Hosts sharing a server are limited together,
+   * their address is known before their first fetch
+   */
+  const unsigned int ip_max_fetch {usets->ip_max_fetch};
+  std::unique_ptr<Resolver> resolver;
+  if (ip_max_fetch > 0) {
+    resolver.reset(new Resolver(status));
+    resolver->attach(&notifier);
+  }
 
-  const unsigned long num_fetchers {url_queues->size()};
-  const unsigned int max_fetch_per_site {10};
-  unsigned int fetcher_id {0};
-  unsigned int num_sent {0};
+  auto send = [&](const std::string& host, HostControl& control, std::unique_ptr<FetchTask>& task) {
+    std::time_t now = std::time(nullptr);
 
-  auto hmapit = history_map.end();
+    if (!control.ip.empty()) {
+      // the fetcher does not resolve the host again
+      task->ip = control.ip;
+      (*usets->mem_sec) += task->ip.size();
+    }
 
-  while (*status) {
-    if (num_sent%num_fetchers == 0) {
-      for (hmapit = history_map.begin(); hmapit != history_map.end(); hmapit++) {
-        if (num_sent - hmapit->second.first > num_fetchers) {
-          // this means that more than 200 request where sent
-          // while the last call, so we set it to zero
-          hmapit->second.second = 0U;
+    std::string url {task->url};
+    usets->router->route(host, std::move(task));
+
+    uint64_t fp = fnv1a(url);
+    if (in_flight.emplace(fp, InFlight {host, control.block, now}).second) {
+      control.in_flight++;
+      control.idle_since = 0;
+      if (!control.block.empty())
+        blocks[control.block].in_flight++;
+      sent_order.emplace_back(now, fp);
+    }
+  };
+
+  /*
+   * Sends the deferred URLs of 'host' its window and
+   * its block allow, it waits for its block otherwise
+   */
+  auto pump = [&](const std::string& host, HostControl& control) {
+    while (!control.deferred.empty() && control.can_send()) {
+      if (resolver && !control.resolved)
+        return;
+
+      if (!control.block.empty()) {
+        auto blockit = blocks.find(control.block);
+        if (blockit != blocks.end() && blockit->second.in_flight >= ip_max_fetch) {
+          if (!control.waiting_block) {
+            blockit->second.waiting.push_back(host);
+            control.waiting_block = true;
+          }
+          return;
         }
       }
-    }
 
-    if (!allowed_queue->empty()) {
-      std::string content;
-      allowed_queue->pop(content);
+      std::unique_ptr<FetchTask> task {std::move(control.deferred.front())};
+      control.deferred.pop_front();
+      queues->num_deferred--;
 
+      send(host, control, task);
+    }
+  };
+
+  /*
+   * A slot of 'block' is free, the hosts waiting for it
+   * are given a turn each
+   */
+  auto drain_block = [&](const std::string& block) {
+    auto blockit = blocks.find(block);
+
+    while (blockit != blocks.end()
+           && blockit->second.in_flight < ip_max_fetch
+           && !blockit->second.waiting.empty()) {
       std::string host;
-      std::string url;
-      unpack(content, {&host, &url});
-
-      if ((hmapit = history_map.find(host)) != history_map.end()) {
-        // the domain was found in the history
-        if (hmapit->second.second < max_fetch_per_site) {
-          // We are under the limit, ok to send it
-          url_queues->at(fetcher_id).push(content);
-
-          fetcher_id++;
-          if (fetcher_id >=  num_fetchers) {
-            fetcher_id = 0;
-          }
+      host.swap(blockit->second.waiting.front());
+      blockit->second.waiting.pop_front();
 
-          num_sent++;
-          hmapit->second.second++;
-        } else {
-          // to many request, put it in the queue
-          allowed_queue->push(content);
-        }
-      } else {
-        // the domain was not found in the history
-        if (history_order.size() > num_fetchers) {
-          // the memory does not need to be greater 
-          // than the number of fetchers !
-          history_map.erase(history_order.front());
-          history_order.pop();
-        }
-        history_map.emplace(host, std::pair<unsigned int, unsigned int>(num_sent, 1U));
-        url_queues->at(fetcher_id).push(content);
-        num_sent++;
+      auto hostit = hosts.find(host);
+      if (hostit != hosts.end()) {
+        hostit->second.waiting_block = false;
+        pump(host, hostit->second);
+      }
 
-        fetcher_id++;
-        if (fetcher_id >=  num_fetchers) {
-          fetcher_id = 0;
-        }
+      blockit = blocks.find(block);
+    }
+
+    if (blockit != blocks.end()
+        && blockit->second.in_flight == 0
+        && blockit->second.waiting.empty())
+      blocks.erase(blockit);
+  };
+
+  /*
+   * The fetch of 'fp' is over, its result moves the window
+   * of its host and the deferred URLs may be sent
+   */
+  auto release = [&](const FetchDone& done, std::time_t now) {
+    auto flit = in_flight.find(done.fp);
+    if (flit == in_flight.end())
+      return; // seeds are not sent by the dispatcher
+
+    std::string host;
+    std::string block;
+    host.swap(flit->second.host);
+    block.swap(flit->second.block);
+    in_flight.erase(flit);
+
+    if (!block.empty())
+      blocks[block].in_flight--;
+
+    HostControl& control = hosts[host];
+    control.done(done.http_code, done.latency, now);
+
+    pump(host, control);
+
+    if (control.in_flight == 0 && control.deferred.empty()) {
+      control.idle_since = now;
+      idle_order.emplace_back(now, host);
+    }
+
+    if (!block.empty())
+      drain_block(block);
+  };
+
+  while (*status) {
+    const unsigned long long seen = notifier.count();
+    std::time_t now = std::time(nullptr);
+
+    FetchDone done;
+    while (queues->done.try_pop(done))
+      release(done, now);
+
+    std::string host;
+    std::string ip;
+    while (resolver && resolver->try_get(host, ip)) {
+      auto hostit = hosts.find(host);
+      if (hostit == hosts.end())
+        continue;
+
+      // a host which cannot be resolved is only limited by its window
+      HostControl& control = hostit->second;
+      control.ip = ip;
+      control.block = ip.empty() ? std::string() : Resolver::block(ip);
+      control.resolving = false;
+      control.resolved = true;
+
+      pump(host, control);
+    }
+
+    while (!sent_order.empty()
+           && now - sent_order.front().first > in_flight_timeout) {
+      auto flit = in_flight.find(sent_order.front().second);
+      // the URL may have been sent again since
+      if (flit != in_flight.end()
+          && flit->second.sent == sent_order.front().first)
+        release({sent_order.front().second, -1L, -1L}, now);
+      sent_order.pop_front();
+    }
+
+    while (!idle_order.empty()
+           && now - idle_order.front().first > idle_timeout) {
+      auto hostit = hosts.find(idle_order.front().second);
+      // the host may have been used since
+      if (hostit != hosts.end()
+          && hostit->second.idle_since == idle_order.front().first)
+        hosts.erase(hostit);
+      idle_order.pop_front();
+    }
+
+    std::unique_ptr<FetchTask> task;
+    while (queues->allowed.try_pop(task)) {
+      host = task->host;
+
+      HostControl& control = hosts[host];
+      control.idle_since = 0;
+
+      if (resolver && !control.resolved && !control.resolving) {
+        resolver->resolve(host);
+        control.resolving = true;
       }
+
+      // waits if its host or its block is busy
+      control.deferred.push_back(std::move(task));
+      queues->num_deferred++;
+
+      pump(host, control);
     }
+
+    /*
+     * Throttled hosts are reported, the others are
+     * running at their initial window or above
+     */
+    if (usets->host_report != nullptr && now - last_report >= 10) {
+      std::ostringstream oss;
+      for (auto& host : hosts)
+        if (!host.second.quiet())
+          host.second.report(host.first, oss);
+      usets->host_report->set(shard_id, oss.str());
+      last_report = now;
+    }
+
+    notifier.wait_for(seen, 1000L);
   }
 }
 
@@ -35,31 +35,97 @@
 #include <map>
 #include <queue>
 #include <thread>
+#include <atomic>
 
 #include "tsafe/thread_safe_queue.h"
+#include "tsafe/thread_safe_ring.h"
 
 #include "common/common.hpp"
+#include "cluster/cluster.hpp"
+#include "urlserver/frontier.hpp"
+#include "urlserver/recrawl.hpp"
+#include "urlserver/hostcontrol.hpp"
+#include "urlserver/traps.hpp"
+#include "urlserver/dust.hpp"
+#include "spider/router.hpp"
 
 #include "urlfactory/urlfactory.hpp"
 
-using TSQueueVector = std::vector<thread_safe::queue<std::string>>;
-
 namespace mermoz
 {
 
+/*
+ * Limits of the crawl of a registrable domain within
+ * a urlserver shard, 0 if not limited
+ */
+typedef struct DomainBudget {
+  uint64_t max_pages;
+  uint64_t max_bytes;
+  uint32_t max_depth; // of the links, for any domain
+} DomainBudget;
+
 typedef struct UrlServerSettings {
   std::string user_agent;
+  unsigned int num_shards;
+  Cluster* cluster; // nullptr if Mermoz runs alone
+  std::string checkpoint_dir; // empty if no checkpoints
+  long checkpoint_interval; // seconds between two snapshots
+  bool resume; // restarts from the last checkpoint
+  FrontierWeights weights; // of the frontier scorers
+  RecrawlSettings recrawl;
+  RecrawlStats* recrawl_stats;
+  HostReport* host_report; // throttled hosts, nullptr if not needed
+  FetcherRouter* router; // gives the URLs to the fetchers
+  unsigned int ip_max_fetch; // fetches in flight per /24 or /48, 0 if not limited
+  DomainBudget budget;
+  const urlfactory::PublicSuffix* suffixes; // gives the domains of the hosts
+  TrapSettings traps;
+  TrapStats* trap_stats;
+  unsigned int dust_min; // same pages to learn a useless argument, 0 disables it
+  HostReport* dust_report;
   MemSec* mem_sec;
 } UrlServerSettings;
 
+/*
+ * Result of a fetch given back to the dispatcher
+ */
+typedef struct FetchDone {
+  uint64_t fp; // of the fetched URL
+  long http_code; // or libcurl error
+  long latency; // time to first byte in ms, -1 if unknown
+} FetchDone;
+
+/*
+ * Shared by a urlserver and its dispatcher
+ */
+typedef struct DispatchQueues {
+  DispatchQueues() : num_deferred(0) {}
+
+  thread_safe::queue<std::unique_ptr<FetchTask>> allowed; // URLs ready to be fetched
+  thread_safe::queue<FetchDone> done; // results of the fetched URLs
+  std::atomic<size_t> num_deferred; // URLs waiting for their busy host
+} DispatchQueues;
+
+/*
+ * One urlserver runs per shard, a shard owns the hosts
+ * for which 'host_shard()' returns 'shard_id' and keeps
+ * its own visited set, robots cache and dispatcher
+ */
 void urlserver(bool* status,
+               unsigned int shard_id,
                UrlServerSettings* usets,
-               TSQueueVector* content_queues,
-               TSQueueVector* url_queues);
+               ParseRing* content_queue,
+               FetchQueueVector* url_queues);
 
+/*
+ * Sends the allowed URLs to the fetchers, the fetches of a host in
+ * flight are limited by its 'HostControl', the others wait within a
+ * list of their host until a result of this host comes back
+ */
 void dispatcher(bool* status,
-                thread_safe::queue<std::string>* allowed_queue,
-                TSQueueVector* url_queues);
+                unsigned int shard_id,
+                UrlServerSettings* usets,
+                DispatchQueues* queues);
 
 } // namespace mermoz
 
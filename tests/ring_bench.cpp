@@ -0,0 +1,187 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+/*
+ * Contention benchmark of the queues between the parsers and the
+ * urlserver shards: thread_safe::ring, one by one and by batches,
+ * against the mutex based thread_safe::queue it replaced. Prints
+ * millions of items per second for each number of threads.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+#include "tsafe/thread_safe_queue.h"
+#include "tsafe/thread_safe_ring.h"
+
+// items as the stages move them, by pointer, a null one ends a consumer
+typedef std::unique_ptr<std::string> Item;
+
+static const uint64_t items_per_producer {400000};
+static const size_t batch_size {64};
+
+typedef struct Queue {
+  thread_safe::queue<Item> queue;
+
+  void produce(uint64_t count)
+  {
+    for (uint64_t i = 0; i < count; i++)
+      queue.push(Item(new std::string()));
+  }
+
+  void end()
+  {
+    queue.push(Item());
+  }
+
+  void consume()
+  {
+    Item u;
+    do {
+      queue.pop(u);
+    } while (u);
+  }
+} Queue;
+
+typedef struct Ring {
+  thread_safe::ring<Item> ring;
+
+  void produce(uint64_t count)
+  {
+    for (uint64_t i = 0; i < count; i++)
+      ring.push(Item(new std::string()));
+  }
+
+  void end()
+  {
+    ring.push(Item());
+  }
+
+  void consume()
+  {
+    Item u;
+    do {
+      ring.pop(u);
+    } while (u);
+  }
+} Ring;
+
+typedef struct RingBatch {
+  thread_safe::ring<Item> ring;
+
+  void produce(uint64_t count)
+  {
+    std::vector<Item> batch(batch_size);
+
+    for (uint64_t i = 0; i < count;) {
+      size_t n = static_cast<size_t>(std::min<uint64_t>(batch_size, count - i));
+      for (size_t j = 0; j < n; j++)
+        batch[j].reset(new std::string());
+
+      // what does not fit waits for room
+      for (size_t j = ring.try_push_batch(batch.data(), n); j < n; j++)
+        ring.push(std::move(batch[j]));
+      i += n;
+    }
+  }
+
+  void end()
+  {
+    ring.push(Item());
+  }
+
+  void consume()
+  {
+    std::vector<Item> batch;
+
+    for (;;) {
+      batch.clear();
+      if (ring.try_pop_batch(batch, batch_size) == 0) {
+        batch.emplace_back();
+        ring.pop(batch.back());
+      }
+
+      // the end markers of the other consumers are given back
+      size_t ends = std::count(batch.begin(), batch.end(), nullptr);
+      if (ends > 0) {
+        for (size_t i = 1; i < ends; i++)
+          end();
+        return;
+      }
+    }
+  }
+} RingBatch;
+
+template <class Q>
+static double run(unsigned int nproducers, unsigned int nconsumers)
+{
+  Q q;
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (unsigned int c = 0; c < nconsumers; c++)
+    consumers.emplace_back([&]() { q.consume(); });
+  for (unsigned int p = 0; p < nproducers; p++)
+    producers.emplace_back([&]() { q.produce(items_per_producer); });
+
+  for (auto& t : producers)
+    t.join();
+  for (unsigned int c = 0; c < nconsumers; c++)
+    q.end();
+  for (auto& t : consumers)
+    t.join();
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return nproducers*items_per_producer/elapsed.count()/1e6;
+}
+
+int main()
+{
+  std::cout << "# producers consumers queue(M/s) ring(M/s) ring_batch(M/s)" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+
+  const unsigned int threads[][2] = {{1, 1}, {2, 2}, {4, 1}, {4, 4}, {8, 8}, {16, 4}};
+
+  for (auto& t : threads) {
+    std::cout << t[0] << " " << t[1] << " "
+              << run<Queue>(t[0], t[1]) << " "
+              << run<Ring>(t[0], t[1]) << " "
+              << run<RingBatch>(t[0], t[1]) << std::endl;
+  }
+
+  return 0;
+}
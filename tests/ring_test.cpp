@@ -0,0 +1,225 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2018 Qwant Research 
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE. 
+ *
+ * Author:
+ * Noel Martin (n.martin@qwantresearch.com)
+ *
+ */
+
+/*
+ * Stress test of thread_safe::ring: several producers and consumers,
+ * one by one or by batches, on rings small enough to be often full
+ * and empty. Every item must come out once, and the items of one
+ * producer in the order they went in.
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+
+#include "tsafe/thread_safe_ring.h"
+
+#define CHECK(cond)                                                      \
+  do {                                                                   \
+    if (!(cond)) {                                                       \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+      std::exit(1);                                                      \
+    }                                                                    \
+  } while (0)
+
+static const uint64_t items_per_producer {200000};
+
+// item 'i' of producer 'p'
+static uint64_t item(unsigned int p, uint64_t i)
+{
+  return (static_cast<uint64_t>(p) << 32) | i;
+}
+
+static void run(unsigned int nproducers,
+                unsigned int nconsumers,
+                size_t capacity,
+                bool batches)
+{
+  thread_safe::ring<uint64_t> ring(capacity);
+  const uint64_t total {nproducers*items_per_producer};
+
+  std::atomic<uint64_t> popped {0};
+  std::vector<std::vector<uint64_t>> seen(nconsumers);
+  std::vector<std::thread> threads;
+
+  for (unsigned int p = 0; p < nproducers; p++) {
+    threads.emplace_back([&, p]() {
+      std::vector<uint64_t> batch;
+      uint64_t i {0};
+
+      while (i < items_per_producer) {
+        if (!batches) {
+          ring.push(item(p, i++));
+          continue;
+        }
+
+        batch.clear();
+        for (uint64_t j = i; j < items_per_producer && batch.size() < 32; j++)
+          batch.push_back(item(p, j));
+
+        // a full ring takes none, the blocking push then waits for room
+        size_t n = ring.try_push_batch(batch.data(), batch.size());
+        if (n == 0)
+          ring.push(std::move(batch[n++]));
+        i += n;
+      }
+    });
+  }
+
+  for (unsigned int c = 0; c < nconsumers; c++) {
+    threads.emplace_back([&, c]() {
+      std::vector<uint64_t> batch;
+      uint64_t u;
+
+      while (popped < total) {
+        if (batches) {
+          batch.clear();
+          size_t n = ring.try_pop_batch(batch, 32);
+          seen[c].insert(seen[c].end(), batch.begin(), batch.end());
+          popped += n;
+          if (n > 0)
+            continue;
+        }
+
+        // an empty ring blocks for a while, the producers may be done
+        if (ring.pop_for(u, 10)) {
+          seen[c].push_back(u);
+          popped++;
+        }
+      }
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  CHECK(popped == total);
+  CHECK(ring.empty());
+
+  std::vector<uint64_t> next(nproducers, 0);
+  std::vector<char> found(total, 0);
+
+  for (auto& items : seen) {
+    std::fill(next.begin(), next.end(), 0);
+
+    for (uint64_t u : items) {
+      unsigned int p = static_cast<unsigned int>(u >> 32);
+      uint64_t i = u & 0xffffffff;
+
+      CHECK(p < nproducers && i < items_per_producer);
+      CHECK(!found[p*items_per_producer + i]);
+      found[p*items_per_producer + i] = 1;
+
+      // one consumer gets the items of a producer in order
+      CHECK(next[p] <= i);
+      next[p] = i + 1;
+    }
+  }
+
+  for (char f : found)
+    CHECK(f);
+
+  std::cout << nproducers << " producers, " << nconsumers << " consumers, "
+            << "capacity " << ring.capacity() << (batches ? ", batches" : "")
+            << ": ok" << std::endl;
+}
+
+/*
+ * push blocks while the ring is full, pop while it is empty,
+ * both are woken by the other side
+ */
+static void waits()
+{
+  thread_safe::ring<std::unique_ptr<int>> ring(2);
+
+  ring.push(std::unique_ptr<int>(new int(1)));
+  ring.push(std::unique_ptr<int>(new int(2)));
+  CHECK(!ring.try_push(std::unique_ptr<int>(new int(0))));
+
+  std::atomic<bool> pushed {false};
+  std::thread producer([&]() {
+    ring.push(std::unique_ptr<int>(new int(3)));
+    pushed = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!pushed);
+
+  std::unique_ptr<int> u;
+  ring.pop(u);
+  CHECK(*u == 1);
+  producer.join();
+  CHECK(pushed);
+
+  ring.pop(u);
+  CHECK(*u == 2);
+  ring.pop(u);
+  CHECK(*u == 3);
+  CHECK(!ring.try_pop(u));
+
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!ring.pop_for(u, 20));
+  CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(15));
+
+  std::atomic<bool> popped {false};
+  std::thread consumer([&]() {
+    std::unique_ptr<int> v;
+    ring.pop(v);
+    CHECK(*v == 4);
+    popped = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(!popped);
+
+  ring.push(std::unique_ptr<int>(new int(4)));
+  consumer.join();
+  CHECK(popped);
+
+  std::cout << "full and empty waits: ok" << std::endl;
+}
+
+int main()
+{
+  waits();
+
+  run(1, 1, 64, false);
+  run(4, 4, 64, false);
+  run(8, 2, 16, false);
+  run(2, 8, 16, false);
+  run(4, 4, 64, true);
+  run(8, 8, 128, true);
+
+  return 0;
+}